@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Monotone priority queue for small non-negative integer keys.
+//
+// Items are popped in increasing order of their keys. The key of a pushed item
+// may not be smaller than the key of the most recently popped item. This
+// allows storing the items in a bucket per key, giving amortized constant time
+// push and pop operations. Items with equal keys are popped in LIFO order.
+template<class T>
+class BucketQueue {
+public:
+	explicit BucketQueue(int keys): buckets(keys) {}
+
+	void push(int key, const T& item) {
+		assert(key >= current && key < (int)buckets.size());
+		buckets[key].push_back(item);
+		++count;
+	}
+
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+
+	// Returns the smallest key in the queue. The queue must not be empty.
+	int topKey() {
+		advance();
+		return current;
+	}
+
+	// Removes and returns an item with the smallest key. The queue must not be
+	// empty.
+	T pop() {
+		advance();
+		std::vector<T>& bucket = buckets[current];
+		T item = bucket.back();
+		bucket.pop_back();
+		--count;
+		return item;
+	}
+
+	// Allows pushing keys smaller than the last popped key again. The queue
+	// must be empty.
+	void rewind() {
+		assert(empty());
+		current = 0;
+	}
+
+private:
+	void advance() {
+		assert(!empty());
+		while(buckets[current].empty()) ++current;
+	}
+
+	std::vector<std::vector<T>> buckets;
+	int current = 0;
+	size_t count = 0;
+};
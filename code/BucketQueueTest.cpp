@@ -0,0 +1,59 @@
+#include "BucketQueue.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+TEST(BucketQueueTest, PopsInKeyOrder) {
+	BucketQueue<int> queue(10);
+	queue.push(5, 50);
+	queue.push(2, 20);
+	queue.push(7, 70);
+	EXPECT_EQ(queue.size(), 3u);
+	EXPECT_EQ(queue.topKey(), 2);
+	EXPECT_EQ(queue.pop(), 20);
+	EXPECT_EQ(queue.pop(), 50);
+	queue.push(5, 51);
+	queue.push(9, 90);
+	EXPECT_EQ(queue.pop(), 51);
+	EXPECT_EQ(queue.pop(), 70);
+	EXPECT_EQ(queue.pop(), 90);
+	EXPECT_TRUE(queue.empty());
+}
+
+TEST(BucketQueueTest, Rewind) {
+	BucketQueue<int> queue(4);
+	queue.push(3, 3);
+	EXPECT_EQ(queue.pop(), 3);
+	queue.rewind();
+	queue.push(0, 0);
+	EXPECT_EQ(queue.topKey(), 0);
+	EXPECT_EQ(queue.pop(), 0);
+}
+
+TEST(BucketQueueTest, RandomMonotone) {
+	mt19937 rng(1);
+	BucketQueue<int> queue(1000);
+	vector<int> expected;
+	int last = 0;
+	for(int i=0; i<500; ++i) {
+		if (queue.empty() || rng()%3) {
+			int key = last + rng()%20;
+			queue.push(key, key);
+			expected.push_back(key);
+		} else {
+			auto it = min_element(expected.begin(), expected.end());
+			last = queue.pop();
+			EXPECT_EQ(last, *it);
+			expected.erase(it);
+		}
+	}
+}
+
+} // namespace
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+// Cooperative cancellation for long-running computations.
+//
+// The token is shared between the computation, which polls `stopRequested`
+// at convenient points, and the controlling code, which may call `cancel`
+// from any thread or give the token a deadline up front.
+class CancelToken {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	CancelToken() = default;
+	explicit CancelToken(Clock::time_point deadline):
+		hasDeadline(true), deadline(deadline) {}
+
+	// Returns a token that expires `timeout` from now.
+	static CancelToken withTimeout(Clock::duration timeout) {
+		return CancelToken(Clock::now() + timeout);
+	}
+
+	CancelToken(const CancelToken& t):
+		cancelled(t.cancelled.load()), hasDeadline(t.hasDeadline), deadline(t.deadline) {}
+
+	void cancel() {
+		cancelled.store(true, std::memory_order_relaxed);
+	}
+
+	// Returns true if `cancel` has been called or the deadline has passed.
+	// Once true, stays true.
+	bool stopRequested() const {
+		if (cancelled.load(std::memory_order_relaxed)) return true;
+		return hasDeadline && Clock::now() >= deadline;
+	}
+
+private:
+	std::atomic<bool> cancelled{false};
+	bool hasDeadline = false;
+	Clock::time_point deadline;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Hash table of per-key totals, for summing counts that may cancel each other
+// out as they are added.
+//
+// Uses open addressing with linear probing over a power of two number of
+// slots. A key whose total returns to the value-initialized V is removed
+// right away, so the table only holds the keys with nonzero totals, however
+// many keys cancelled out before. The table keeps its capacity over clears,
+// so a table reused for many rounds stops allocating once it has grown to fit
+// the largest one.
+template<class K, class V, class Hash = std::hash<K>>
+class CountTable {
+public:
+	// Applies `change` to the total of `key`, which is value-initialized if
+	// the key is missing.
+	template<class F>
+	void update(const K& key, F&& change) {
+		if (2*(items.size()+1) > slots.size()) grow();
+		size_t i = slotOf(key);
+		for(; slots[i] >= 0; i = (i+1) & (slots.size()-1)) {
+			if (items[slots[i]].first == key) break;
+		}
+		if (slots[i] < 0) {
+			slots[i] = items.size();
+			items.emplace_back(key, V());
+		}
+		V& total = items[slots[i]].second;
+		change(total);
+		if (total == V()) erase(i);
+	}
+
+	// Keys with nonzero totals and their totals, in no particular order.
+	const std::vector<std::pair<K, V>>& entries() const { return items; }
+	bool empty() const { return items.empty(); }
+	size_t capacity() const { return slots.size(); }
+
+	void clear() {
+		for(const auto& item: items) slots[find(item.first)] = -1;
+		items.clear();
+	}
+
+private:
+	// Scrambles the hash with a multiplicative hash, as the hashes of small
+	// coordinates differ mostly in their low bits.
+	size_t slotOf(const K& key) const {
+		return (uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull >> shift;
+	}
+
+	// Returns the slot of `key`, which must be in the table.
+	size_t find(const K& key) const {
+		size_t i = slotOf(key);
+		while(!(items[slots[i]].first == key)) i = (i+1) & (slots.size()-1);
+		return i;
+	}
+
+	// Removes the item in slot `i`. The last item takes its place in `items`,
+	// and the following items of the probe run are shifted back so that no
+	// lookup stops early at the freed slot.
+	void erase(size_t i) {
+		size_t item = slots[i];
+		if (item+1 != items.size()) {
+			slots[find(items.back().first)] = item;
+			items[item] = std::move(items.back());
+		}
+		items.pop_back();
+		size_t mask = slots.size()-1;
+		for(size_t j = (i+1) & mask; slots[j] >= 0; j = (j+1) & mask) {
+			size_t home = slotOf(items[slots[j]].first);
+			if (((j-home) & mask) >= ((j-i) & mask)) {
+				slots[i] = slots[j];
+				i = j;
+			}
+		}
+		slots[i] = -1;
+	}
+
+	void grow() {
+		size_t size = slots.empty() ? 16 : 2*slots.size();
+		shift = 64;
+		for(size_t s = size; s > 1; s >>= 1) --shift;
+		slots.assign(size, -1);
+		for(size_t item=0; item<items.size(); ++item) {
+			size_t i = slotOf(items[item].first);
+			while(slots[i] >= 0) i = (i+1) & (size-1);
+			slots[i] = item;
+		}
+	}
+
+	// Index in `items` of the key in each slot, or -1.
+	std::vector<int> slots;
+	std::vector<std::pair<K, V>> items;
+	int shift = 64;
+};
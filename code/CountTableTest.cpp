@@ -0,0 +1,80 @@
+#include "CountTable.hpp"
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+// Hashes runs of keys to the same value, to make long probe runs.
+struct CoarseHash {
+	size_t operator()(int key) const { return key/16; }
+};
+
+template<class Hash>
+void add(CountTable<int, int, Hash>& table, int key, int delta) {
+	table.update(key, [delta](int& total) { total += delta; });
+}
+
+TEST(CountTableTest, SumsPerKey) {
+	CountTable<int, int> table;
+	EXPECT_TRUE(table.empty());
+	add(table, 3, 1);
+	add(table, 5, -1);
+	add(table, 3, 1);
+	add(table, 5, 1);
+	vector<pair<int, int>> expected = {{3, 2}};
+	EXPECT_EQ(table.entries(), expected);
+	table.clear();
+	EXPECT_TRUE(table.empty());
+	add(table, 5, 0);
+	EXPECT_TRUE(table.empty());
+}
+
+TEST(CountTableTest, KeepsCapacityOverClears) {
+	CountTable<int, int> table;
+	for(int i=0; i<1000; ++i) add(table, i, 1);
+	size_t capacity = table.capacity();
+	for(int round=0; round<10; ++round) {
+		table.clear();
+		for(int i=0; i<1000; ++i) add(table, i*7 + round, 1);
+		EXPECT_EQ(table.capacity(), capacity);
+		EXPECT_EQ(table.entries().size(), 1000u);
+	}
+}
+
+TEST(CountTableTest, CancelledKeysLeave) {
+	CountTable<int, int> table;
+	for(int i=0; i<100000; ++i) {
+		add(table, i, 1);
+		add(table, i+1, 1);
+		add(table, i, -1);
+		add(table, i+1, -1);
+	}
+	EXPECT_TRUE(table.empty());
+	EXPECT_LE(table.capacity(), 16u);
+}
+
+TEST(CountTableTest, Random) {
+	mt19937 rng(1);
+	CountTable<int, int, CoarseHash> table;
+	for(int round=0; round<20; ++round) {
+		map<int, int> expected;
+		int n = rng()%2000;
+		for(int i=0; i<n; ++i) {
+			int key = rng()%500, delta = rng()%2 ? 1 : -1;
+			add(table, key, delta);
+			if ((expected[key] += delta) == 0) expected.erase(key);
+		}
+		map<int, int> actual(table.entries().begin(), table.entries().end());
+		EXPECT_EQ(actual, expected);
+		EXPECT_EQ(table.entries().size(), expected.size());
+		table.clear();
+	}
+}
+
+} // namespace
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "Box.hpp"
+#include "TreeStructure.hpp"
+#include "util.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Bitmask of query lanes. Bit i is set if the value concerns the i'th of up to
+// LANES independent queries.
+using LaneMask = uint64_t;
+constexpr int LANES = 64;
+
+// Calls `f(lane)` for each lane set in `lanes` in increasing order.
+template<class F>
+void forEachLane(LaneMask lanes, F&& f) {
+	for(; lanes; lanes &= lanes-1) {
+		f(__builtin_ctzll(lanes));
+	}
+}
+
+// Bit-sliced version of `UnifiedTree` holding up to LANES independent trees.
+//
+// The trees share the node layout and traversals: each node stores a lane mask
+// per `hasData` bit instead of a single bit, and every operation takes the
+// mask of lanes it applies to. The result for each lane is the same as if the
+// operation was run on a separate `UnifiedTree` for the lane, but a single
+// traversal serves all the lanes.
+//
+// The per-lane values of fully covered nodes are stored in a separate pool,
+// allocated for a node the first time it becomes fully covered for any lane.
+template<class T, int D>
+class LaneTree {
+public:
+	using Index = std::array<int, D>;
+	using Values = std::array<T, LANES>;
+
+	LaneTree(Index sizes) {
+		int total = 1;
+		for(int i=D-1; i>=0; --i) {
+			int s = toPow2(sizes.begin()[i]);
+			size[i] = s;
+			stepSize[i] = total;
+			total *= 2*s;
+		}
+		data.resize(total);
+	}
+
+	// Fills the region of `box` by `value` in each of `lanes`.
+	void add(const Box<D>& box, LaneMask lanes, const T& value) {
+		if (lanes) addRec(0, 0, 0, box, lanes, value);
+	}
+
+	// Returns the subset of `lanes` where some added box intersects `box`.
+	LaneMask check(const Box<D>& box, LaneMask lanes) const {
+		return lanes ? checkRec(0, 0, 0, box, lanes) : 0;
+	}
+
+	// Clears the region of `box` in each of `lanes`. Calls
+	// `visitor(index, cleared, values)` for each cleared node, where
+	// `cleared` is the mask of lanes where the node was fully covered and
+	// `values[lane]` is the value of the node in each of those lanes.
+	template<class V>
+	void remove(Box<D> box, LaneMask lanes, V&& visitor) {
+		if (!lanes) return;
+		for(int i=0; i<D; ++i) if (box[i].size()==0) return;
+		Index ones;
+		for(int i=0; i<D; ++i) ones[i]=1;
+		removeInSubtree(ones, 0, box, lanes, visitor);
+	}
+
+	Index getSize() const { return size; }
+
+	Range rangeForIndex(int axis, int index) const {
+		return TreeStructure{2*size[axis]}.indexToRange(index);
+	}
+
+private:
+	// Single internal node. Same as `UnifiedTree::Item`, but `hasData[m]` is
+	// the mask of lanes where the bit would be set.
+	struct Item {
+		std::array<LaneMask, 1<<D> hasData = {};
+		// Index of the per-lane values in `values`, or -1.
+		int slot = -1;
+	};
+	using Mask = unsigned;
+
+	void addRec(int index, int axis, Mask covered, const Box<D>& box, LaneMask lanes, const T& value) {
+		if (axis == D) {
+			addToItem(index, covered, lanes, value);
+			return;
+		}
+		int s = size[axis];
+		int step = stepSize[axis];
+		Range range = box[axis];
+		if (range.size()==0) return;
+		int a,b,ap,bp;
+		for(a=s+range.from, b=s+range.to-1, ap=a, bp=b; a<=b; a/=2, b/=2, ap/=2, bp/=2) {
+			if (a != ap) {
+				addRec(index + step*ap, axis+1, covered, box, lanes, value);
+			}
+			if (b != bp) {
+				addRec(index + step*bp, axis+1, covered, box, lanes, value);
+			}
+			if (a&1) {
+				addRec(index + step*a++, axis+1, covered | (1U << axis), box, lanes, value);
+			}
+			if (!(b&1)) {
+				addRec(index + step*b--, axis+1, covered | (1U << axis), box, lanes, value);
+			}
+		}
+		for(; ap > 0; ap/=2, bp/=2) {
+			addRec(index + step*ap, axis+1, covered, box, lanes, value);
+			if (ap != bp) {
+				addRec(index + step*bp, axis+1, covered, box, lanes, value);
+			}
+		}
+	}
+
+	void addToItem(int index, Mask covered, LaneMask lanes, const T& value) {
+		if (covered == ALL_MASK) {
+			assignItem(index, lanes, [&](int) -> const T& { return value; });
+		} else {
+			Item& x = data[index];
+			for(Mask i=0; i<1<<D; ++i) {
+				if (i == (i & covered)) {
+					x.hasData[i] |= lanes;
+				}
+			}
+		}
+	}
+
+	// Marks node `index` fully covered in `lanes`, setting the value of each
+	// lane that was not yet fully covered to `value(lane)`.
+	template<class F>
+	void assignItem(int index, LaneMask lanes, F&& value) {
+		Item& x = data[index];
+		LaneMask fresh = lanes & ~x.hasData[ALL_MASK];
+		if (!fresh) return;
+		if (x.slot < 0) {
+			x.slot = values.size();
+			values.emplace_back();
+		}
+		Values& v = values[x.slot];
+		forEachLane(fresh, [&](int lane) { v[lane] = value(lane); });
+		for(LaneMask& m: x.hasData) m |= fresh;
+	}
+
+	LaneMask checkRec(int index, int axis, Mask covered, const Box<D>& box, LaneMask lanes) const {
+		if (axis == D) {
+			return data[index].hasData[covered ^ ALL_MASK] & lanes;
+		}
+		int s = size[axis];
+		int step = stepSize[axis];
+		Range range = box[axis];
+		if (range.size()==0) return 0;
+		LaneMask res = 0;
+		// Visits a node and returns true when all the lanes are found.
+		auto visit = [&](int node, Mask c) {
+			res |= checkRec(index + step*node, axis+1, c, box, lanes & ~res);
+			return res == lanes;
+		};
+		int a,b,ap,bp;
+		for(a=s+range.from, b=s+range.to-1, ap=a, bp=b; a<=b; a/=2, b/=2, ap/=2, bp/=2) {
+			if (a != ap && visit(ap, covered)) return res;
+			if (b != bp && ap!=bp && visit(bp, covered)) return res;
+			if ((a&1) && visit(a++, covered | (1U << axis))) return res;
+			if (!(b&1) && visit(b--, covered | (1U << axis))) return res;
+		}
+		for(; ap > 0; ap/=2, bp/=2) {
+			if (visit(ap, covered)) return res;
+			if (ap != bp && visit(bp, covered)) return res;
+		}
+		return res;
+	}
+
+	// Same as `UnifiedTree::removeInSubtree` limited to `lanes`. Lanes without
+	// data in the node are dropped, as their subtree is empty.
+	template<class V>
+	void removeInSubtree(Index index, int axis, const Box<D>& box, LaneMask lanes, V& visitor) {
+		int totalIndex = computeIndex(index);
+		Item& item = data[totalIndex];
+		lanes &= item.hasData[0];
+		if (!lanes) return;
+		if (axis == D) {
+			LaneMask full = item.hasData[ALL_MASK] & lanes;
+			if (full) {
+				const Values& v = values[item.slot];
+				visitor(index, full, v);
+			}
+			for(LaneMask& m: item.hasData) m &= ~lanes;
+			return;
+		}
+		Range range = rangeForIndex(axis, index[axis]);
+		if (!range.intersects(box[axis])) return;
+		bool isParent = !box[axis].contains(range);
+		if (isParent) {
+			propagateInSubtree(index, axis+1, box, lanes, axis);
+		}
+		removeInSubtree(index, axis+1, box, lanes, visitor);
+		int i = index[axis];
+		if (i < size[axis]) {
+			removeInSubtree(withIndex(index, axis, 2*i), axis, box, lanes, visitor);
+			removeInSubtree(withIndex(index, axis, 2*i+1), axis, box, lanes, visitor);
+		}
+		if (isParent) {
+			computeChildData(index, axis+1, box, lanes);
+		}
+	}
+
+	void propagateInSubtree(Index index, int axis, const Box<D>& box, LaneMask lanes, int splitAxis) {
+		if (axis == D) {
+			int totalIndex = computeIndex(index);
+			Item& t = data[totalIndex];
+			lanes &= t.hasData[0];
+			if (!lanes) return;
+			int step = stepSize[splitAxis];
+			int i = index[splitAxis];
+			int baseIndex = totalIndex - step * i;
+			int left = baseIndex + step * (2*i), right = baseIndex + step * (2*i+1);
+			LaneMask full = t.hasData[ALL_MASK] & lanes;
+			if (full) {
+				// Looked up on each call, as the assignments may reallocate
+				// `values`.
+				auto value = [&](int lane) { return values[t.slot][lane]; };
+				assignItem(left, full, value);
+				assignItem(right, full, value);
+				t.hasData[ALL_MASK] &= ~full;
+			}
+			LaneMask partial = t.hasData[1 << splitAxis] & lanes & ~full;
+			if (partial) {
+				for(Mask m=0; m<1<<D; ++m) {
+					data[left].hasData[m] |= t.hasData[m] & partial;
+					data[right].hasData[m] |= t.hasData[m] & partial;
+				}
+			}
+			return;
+		}
+		Range range = rangeForIndex(axis, index[axis]);
+		if (!range.intersects(box[axis])) return;
+		propagateInSubtree(index, axis+1, box, lanes, splitAxis);
+		int i = index[axis];
+		if (i < size[axis]) {
+			propagateInSubtree(withIndex(index, axis, 2*i), axis, box, lanes, splitAxis);
+			propagateInSubtree(withIndex(index, axis, 2*i+1), axis, box, lanes, splitAxis);
+		}
+	}
+
+	void computeChildData(Index index, int axis, const Box<D>& box, LaneMask lanes) {
+		if (axis == D) {
+			Mask covered = 0;
+			for(int i=0; i<D; ++i) {
+				Range r = rangeForIndex(i, index[i]);
+				covered |= box[i].contains(r) << i;
+			}
+			return genSubtreeState(index, covered, lanes);
+		}
+		int i = index[axis];
+		if (i < size[axis]) {
+			computeChildData(withIndex(index, axis, 2*i), axis, box, lanes);
+			computeChildData(withIndex(index, axis, 2*i+1), axis, box, lanes);
+		}
+		computeChildData(withIndex(index, axis, i), axis+1, box, lanes);
+	}
+
+	void genSubtreeState(Index index, Mask covered, LaneMask lanes) {
+		int totalIndex = computeIndex(index);
+		Item& t = data[totalIndex];
+		lanes &= ~t.hasData[ALL_MASK];
+		if (!lanes) return;
+		for(LaneMask& m: t.hasData) m &= ~lanes;
+		for(int d=0; d<D; ++d) {
+			if (index[d] >= size[d]) continue;
+			if (1 & (covered >> d)) continue;
+			int x = index[d];
+			int step = stepSize[d];
+			int baseIndex = totalIndex - step*x;
+			const Item& a = data[baseIndex + step*(2*x)];
+			const Item& b = data[baseIndex + step*(2*x+1)];
+			for(Mask i=0; i<1<<D; ++i) {
+				if (!(1 & i>>d)) t.hasData[i] |= (a.hasData[i] | b.hasData[i]) & lanes;
+			}
+		}
+	}
+
+	static Index withIndex(Index index, int axis, int x) {
+		index[axis] = x;
+		return index;
+	}
+
+	int computeIndex(const Index& index) const {
+		int r=0;
+		for(int i=0; i<D; ++i) r += stepSize[i] * index[i];
+		return r;
+	}
+
+	static constexpr Mask ALL_MASK = (1U<<D)-1;
+
+	Index size = {};
+	Index stepSize = {};
+	std::vector<Item> data;
+	std::vector<Values> values;
+};
@@ -0,0 +1,107 @@
+#include "LaneTree.hpp"
+#include "UnifiedTree.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+template<int D>
+Box<D> randomBox(int size, mt19937& rng) {
+	Box<D> box;
+	for(int j=0; j<D; ++j) {
+		int a = rng()%(size+1), b = rng()%(size+1);
+		if (a>b) swap(a,b);
+		box[j] = {a,b};
+	}
+	return box;
+}
+
+LaneMask randomLanes(int lanes, mt19937& rng) {
+	LaneMask res = 0;
+	for(int i=0; i<lanes; ++i) {
+		if (rng()%2) res |= LaneMask(1) << i;
+	}
+	return res;
+}
+
+// Runs random operations on a lane tree and on a separate unified tree per
+// lane, and checks that they agree on every lane.
+template<int D>
+void runRandomLaneOps(int size, int lanes, int n, mt19937& rng) {
+	using Index = typename LaneTree<int, D>::Index;
+	using Visits = vector<pair<Index, int>>;
+	Index sz;
+	for(int i=0; i<D; ++i) sz[i] = size;
+	LaneTree<int, D> tree(sz);
+	vector<UnifiedTree<int, D>> expected(lanes, UnifiedTree<int, D>(sz));
+	for(int i=0; i<n; ++i) {
+		Box<D> box = randomBox<D>(size, rng);
+		LaneMask mask = randomLanes(lanes, rng);
+		switch(rng()%3) {
+			case 0:
+				tree.add(box, mask, i);
+				forEachLane(mask, [&](int l) { expected[l].add(box, i); });
+				break;
+			case 1: {
+				vector<Visits> actualVisits(lanes), expectedVisits(lanes);
+				tree.remove(box, mask, [&](const Index& idx, LaneMask cleared, const typename LaneTree<int, D>::Values& values) {
+					EXPECT_EQ(cleared & ~mask, 0u);
+					forEachLane(cleared, [&](int l) {
+						actualVisits[l].emplace_back(idx, values[l]);
+					});
+				});
+				forEachLane(mask, [&](int l) {
+					expected[l].remove(box, [&](const Index& idx, int x) {
+						expectedVisits[l].emplace_back(idx, x);
+					});
+				});
+				EXPECT_EQ(actualVisits, expectedVisits) << box;
+				break;
+			}
+			case 2: {
+				LaneMask res = tree.check(box, mask);
+				for(int l=0; l<lanes; ++l) {
+					bool lit = mask>>l & 1 && expected[l].check(box);
+					EXPECT_EQ(res>>l & 1, lit) << box << ' ' << l;
+				}
+				break;
+			}
+		}
+	}
+}
+
+TEST(LaneTreeTest1D, RandomOps) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		runRandomLaneOps<1>(32, 8, 50, rng);
+	}
+}
+
+TEST(LaneTreeTest2D, RandomOps) {
+	for(int i=0; i<50; ++i) {
+		mt19937 rng(i);
+		runRandomLaneOps<2>(16, 8, 50, rng);
+	}
+}
+
+TEST(LaneTreeTest2D, AllLanes) {
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		runRandomLaneOps<2>(8, LANES, 50, rng);
+	}
+}
+
+TEST(LaneTreeTest3D, RandomOps) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		runRandomLaneOps<3>(8, 4, 50, rng);
+	}
+}
+
+} // namespace
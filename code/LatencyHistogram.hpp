@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// Histogram of durations in nanoseconds with logarithmic buckets.
+//
+// Each power of two is split into 8 buckets, so a quantile is reported with
+// at most 12.5% relative error. Durations of up to 2^40 ns (about 18
+// minutes) are told apart, and longer ones fall in the last bucket.
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKETS = 8;
+	static constexpr int BUCKETS = SUB_BUCKETS * 38;
+
+	void add(uint64_t nanos) {
+		++counts[bucket(nanos)];
+		++total;
+		sumNanos += nanos;
+		if (nanos > maximum) maximum = nanos;
+	}
+
+	// Adds the durations counted per bucket in `bucketCounts`, whose sum is
+	// `sum` and the largest of which is `largest`. Used to build a histogram
+	// from counters kept elsewhere.
+	void addCounts(const std::array<uint64_t, BUCKETS>& bucketCounts, uint64_t sum, uint64_t largest) {
+		for(int i=0; i<BUCKETS; ++i) {
+			counts[i] += bucketCounts[i];
+			total += bucketCounts[i];
+		}
+		sumNanos += sum;
+		if (largest > maximum) maximum = largest;
+	}
+
+	void merge(const LatencyHistogram& h) {
+		for(int i=0; i<BUCKETS; ++i) counts[i] += h.counts[i];
+		total += h.total;
+		sumNanos += h.sumNanos;
+		if (h.maximum > maximum) maximum = h.maximum;
+	}
+
+	uint64_t count() const { return total; }
+	uint64_t sum() const { return sumNanos; }
+	uint64_t max() const { return maximum; }
+
+	// Returns an upper bound for the `q` quantile for q in [0, 1], or 0 if
+	// the histogram is empty.
+	uint64_t quantile(double q) const {
+		if (total == 0) return 0;
+		uint64_t rank = q * (total - 1);
+		uint64_t seen = 0;
+		for(int i=0; i<BUCKETS; ++i) {
+			seen += counts[i];
+			if (seen > rank) return i == BUCKETS-1 ? maximum : std::min(bucketEnd(i) - 1, maximum);
+		}
+		return maximum;
+	}
+
+	// Number of durations in bucket `i`, which holds the durations in
+	// [bucketStart(i), bucketEnd(i)).
+	uint64_t bucketCount(int i) const { return counts[i]; }
+
+	static int bucket(uint64_t nanos) {
+		if (nanos < SUB_BUCKETS) return nanos;
+		int exp = 63 - __builtin_clzll(nanos);
+		int i = SUB_BUCKETS * (exp - 2) + (nanos >> (exp - 3) & (SUB_BUCKETS - 1));
+		return i < BUCKETS ? i : BUCKETS-1;
+	}
+	static uint64_t bucketStart(int i) {
+		if (i < SUB_BUCKETS) return i;
+		int exp = i / SUB_BUCKETS + 2;
+		return (uint64_t)(SUB_BUCKETS + i % SUB_BUCKETS) << (exp - 3);
+	}
+	static uint64_t bucketEnd(int i) {
+		return bucketStart(i + 1);
+	}
+
+private:
+	std::array<uint64_t, BUCKETS> counts{};
+	uint64_t total = 0;
+	uint64_t sumNanos = 0;
+	uint64_t maximum = 0;
+};
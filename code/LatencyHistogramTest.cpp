@@ -0,0 +1,55 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+TEST(LatencyHistogramTest, Buckets) {
+	for(uint64_t x: {0ull, 1ull, 7ull, 8ull, 9ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, (1ull<<40) - 1}) {
+		int i = LatencyHistogram::bucket(x);
+		EXPECT_LE(LatencyHistogram::bucketStart(i), x) << x;
+		EXPECT_LT(x, LatencyHistogram::bucketEnd(i)) << x;
+	}
+	EXPECT_EQ(LatencyHistogram::bucket(1ull<<50), LatencyHistogram::BUCKETS-1);
+	for(int i=0; i+1<LatencyHistogram::BUCKETS; ++i) {
+		EXPECT_EQ(LatencyHistogram::bucket(LatencyHistogram::bucketStart(i)), i);
+		EXPECT_EQ(LatencyHistogram::bucket(LatencyHistogram::bucketEnd(i) - 1), i);
+	}
+}
+
+TEST(LatencyHistogramTest, Quantiles) {
+	mt19937 rng(0);
+	vector<uint64_t> values;
+	LatencyHistogram a, b;
+	for(int i=0; i<10000; ++i) {
+		uint64_t x = rng() % 1000000;
+		values.push_back(x);
+		(i%2 ? a : b).add(x);
+	}
+	a.merge(b);
+	sort(values.begin(), values.end());
+	EXPECT_EQ(a.count(), values.size());
+	EXPECT_EQ(a.max(), values.back());
+	EXPECT_EQ(a.sum(), accumulate(values.begin(), values.end(), uint64_t(0)));
+	for(double q: {0.0, 0.5, 0.9, 0.99, 1.0}) {
+		uint64_t exact = values[q * (values.size() - 1)];
+		uint64_t approx = a.quantile(q);
+		EXPECT_GE(approx, exact) << q;
+		EXPECT_LE(approx, exact + exact/8 + 1) << q;
+	}
+}
+
+TEST(LatencyHistogramTest, Empty) {
+	LatencyHistogram h;
+	EXPECT_EQ(h.count(), 0u);
+	EXPECT_EQ(h.quantile(0.5), 0u);
+}
+
+} // namespace
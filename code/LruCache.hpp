@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Bounded map that evicts the least recently used entry when full.
+//
+// All the operations lock the cache, so it may be used from several threads
+// at the same time. Lookups update the recency order, so they lock as well.
+template<class K, class V, class Hash = std::hash<K>>
+class LruCache {
+public:
+	// Cache holding at most `capacity` entries. Zero capacity disables it.
+	explicit LruCache(size_t capacity): capacity(capacity) {}
+
+	// Sets `value` to the value of `key` and returns true if `key` is cached.
+	bool get(const K& key, V& value) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(key);
+		if (it == index.end()) return false;
+		entries.splice(entries.begin(), entries, it->second);
+		value = it->second->second;
+		return true;
+	}
+
+	// Sets the value of `key`, marking it as the most recently used.
+	void put(const K& key, V value) {
+		if (capacity == 0) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			it->second->second = std::move(value);
+			entries.splice(entries.begin(), entries, it->second);
+			return;
+		}
+		if (entries.size() == capacity) {
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+		entries.emplace_front(key, std::move(value));
+		index[key] = entries.begin();
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(mutex);
+		index.clear();
+		entries.clear();
+	}
+
+	size_t size() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return entries.size();
+	}
+
+private:
+	using Entries = std::list<std::pair<K, V>>;
+
+	const size_t capacity;
+	mutable std::mutex mutex;
+	// Entries from the most to the least recently used.
+	Entries entries;
+	std::unordered_map<K, typename Entries::iterator, Hash> index;
+};
@@ -0,0 +1,75 @@
+#include "LruCache.hpp"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+	LruCache<int, int> cache(2);
+	int x = 0;
+	cache.put(1, 10);
+	cache.put(2, 20);
+	EXPECT_TRUE(cache.get(1, x));
+	EXPECT_EQ(x, 10);
+	cache.put(3, 30);
+	EXPECT_FALSE(cache.get(2, x));
+	EXPECT_TRUE(cache.get(1, x));
+	EXPECT_TRUE(cache.get(3, x));
+	EXPECT_EQ(x, 30);
+	EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(LruCacheTest, PutUpdatesValue) {
+	LruCache<int, int> cache(2);
+	int x = 0;
+	cache.put(1, 10);
+	cache.put(2, 20);
+	cache.put(1, 11);
+	cache.put(3, 30);
+	EXPECT_TRUE(cache.get(1, x));
+	EXPECT_EQ(x, 11);
+	EXPECT_FALSE(cache.get(2, x));
+}
+
+TEST(LruCacheTest, ZeroCapacity) {
+	LruCache<int, int> cache(0);
+	int x = 0;
+	cache.put(1, 10);
+	EXPECT_FALSE(cache.get(1, x));
+	EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(LruCacheTest, Clear) {
+	LruCache<int, int> cache(4);
+	int x = 0;
+	cache.put(1, 10);
+	cache.clear();
+	EXPECT_FALSE(cache.get(1, x));
+	EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(LruCacheTest, ConcurrentAccess) {
+	LruCache<int, int> cache(16);
+	vector<thread> threads;
+	for(int t=0; t<4; ++t) {
+		threads.emplace_back([&cache, t] {
+			for(int i=0; i<10000; ++i) {
+				int key = (i*7 + t) % 32, x = -1;
+				if (cache.get(key, x)) {
+					EXPECT_EQ(x, 2*key);
+				} else {
+					cache.put(key, 2*key);
+				}
+			}
+		});
+	}
+	for(thread& t: threads) t.join();
+	EXPECT_LE(cache.size(), 16u);
+}
+
+} // namespace
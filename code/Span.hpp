@@ -7,11 +7,12 @@ template<class T>
 class Span {
 public:
 	template<class C>
-	Span(C& v): Span(&*v.begin(), &*v.end()) {}
+	Span(C& v): Span(v.data(), v.data() + v.size()) {}
 	Span(T* a, T* b): from(a), to(b) {}
 
 	T& operator[](int i) const { return from[i]; }
 	int size() const { return to-from; }
+	T* data() const { return from; }
 	T* begin() const { return from; }
 	T* end() const { return to; }
 
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Box.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Iterative segment tree layout over the elementary ranges between the
+// sorted distinct coordinates `coords` along one axis. Node i has children 2i
+// and 2i+1, and the leaves are at n..2n-1 for n elementary ranges.
+class StabbingAxis {
+protected:
+	// Sets `coords` to the boundaries of `boxes` along `axis` and returns the
+	// number of nodes.
+	template<int K>
+	int setCoords(const std::vector<Box<K>>& boxes, int axis) {
+		for(const Box<K>& b: boxes) {
+			coords.push_back(b[axis].from);
+			coords.push_back(b[axis].to);
+		}
+		sortUnique(coords);
+		return 2 * (std::max<int>(coords.size(), 1) - 1);
+	}
+
+	// Calls `f(node)` for the nodes in the canonical decomposition of `r`.
+	template<class F>
+	void forCoveredNodes(Range r, F&& f) const {
+		if (r.empty()) return;
+		int n = coords.size() - 1;
+		int l = std::lower_bound(coords.begin(), coords.end(), r.from) - coords.begin() + n;
+		int h = std::lower_bound(coords.begin(), coords.end(), r.to) - coords.begin() + n;
+		for(; l<h; l>>=1, h>>=1) {
+			if (l&1) f(l++);
+			if (h&1) f(--h);
+		}
+	}
+
+	// Calls `f(node)` for the nodes whose range contains coordinate `x`.
+	template<class F>
+	void forNodesOnPath(int x, F&& f) const {
+		int n = coords.size() - 1;
+		int leaf = std::upper_bound(coords.begin(), coords.end(), x) - coords.begin() - 1;
+		if (leaf < 0 || leaf >= n) return;
+		for(int i=leaf+n; i>0; i>>=1) f(i);
+	}
+
+	std::vector<int> coords;
+};
+
+// Static K-dimensional segment tree for finding the boxes containing a point.
+//
+// The outer tree is a segment tree over the compressed coordinates of the last
+// axis. Each box is stored in the O(log n) nodes that its range covers, and
+// each node holds a (K-1)-dimensional tree of its boxes with the last axis
+// removed. The boxes of the 1-dimensional trees are kept in buckets of ids.
+// A point query visits the buckets on O(log^K n) nodes, and a box containing
+// the point is in exactly one of them.
+template<int K>
+class StabbingTree: private StabbingAxis {
+public:
+	StabbingTree() {}
+	// Builds the tree of `boxes`, where `ids[i]` identifies `boxes[i]` in the
+	// buckets. Empty boxes are ignored.
+	StabbingTree(const std::vector<Box<K>>& boxes, const std::vector<int>& ids) {
+		int count = setCoords(boxes, K-1);
+		std::vector<std::vector<int>> nodeBoxes(count);
+		for(size_t i=0; i<boxes.size(); ++i) {
+			forCoveredNodes(boxes[i][K-1], [&](int node) { nodeBoxes[node].push_back(i); });
+		}
+		nodes.resize(count);
+		std::vector<Box<K-1>> projected;
+		std::vector<int> projectedIds;
+		for(int i=0; i<count; ++i) {
+			projected.clear();
+			projectedIds.clear();
+			for(int j: nodeBoxes[i]) {
+				projected.push_back(boxes[j].project());
+				projectedIds.push_back(ids[j]);
+			}
+			if (!projected.empty()) nodes[i] = StabbingTree<K-1>(projected, projectedIds);
+		}
+	}
+
+	// Calls `f(bucket)` for the buckets that may hold boxes containing `p`. The
+	// boxes in the buckets contain `p`, and each box containing `p` is in one
+	// of the buckets.
+	template<class F>
+	void stab(const Point<K>& p, F&& f) const {
+		Point<K-1> q;
+		for(int i=0; i<K-1; ++i) q[i] = p[i];
+		forNodesOnPath(p[K-1], [&](int node) { nodes[node].stab(q, f); });
+	}
+
+	// Calls `f(bucket)` for each non-empty bucket of the tree.
+	template<class F>
+	void forEachBucket(F&& f) {
+		for(StabbingTree<K-1>& node: nodes) node.forEachBucket(f);
+	}
+
+private:
+	std::vector<StabbingTree<K-1>> nodes;
+};
+
+template<>
+class StabbingTree<1>: private StabbingAxis {
+public:
+	StabbingTree() {}
+	StabbingTree(const std::vector<Box<1>>& boxes, const std::vector<int>& ids) {
+		buckets.resize(setCoords(boxes, 0));
+		for(size_t i=0; i<boxes.size(); ++i) {
+			forCoveredNodes(boxes[i][0], [&](int node) { buckets[node].push_back(ids[i]); });
+		}
+	}
+
+	template<class F>
+	void stab(const Point<1>& p, F&& f) const {
+		forNodesOnPath(p[0], [&](int node) {
+			if (!buckets[node].empty()) f(buckets[node]);
+		});
+	}
+
+	template<class F>
+	void forEachBucket(F&& f) {
+		for(std::vector<int>& bucket: buckets) {
+			if (!bucket.empty()) f(bucket);
+		}
+	}
+
+private:
+	std::vector<std::vector<int>> buckets;
+};
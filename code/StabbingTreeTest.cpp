@@ -0,0 +1,68 @@
+#include "StabbingTree.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+template<int K>
+void checkRandomStabbing(int size, int n, mt19937& rng) {
+	vector<Box<K>> boxes(n);
+	vector<int> ids(n);
+	for(int i=0; i<n; ++i) {
+		for(int j=0; j<K; ++j) {
+			int a = rng()%(size+1), b = rng()%(size+1);
+			boxes[i][j] = {min(a,b), max(a,b)};
+		}
+		ids[i] = 100+i;
+	}
+	StabbingTree<K> tree(boxes, ids);
+	for(int i=0; i<50; ++i) {
+		Point<K> p;
+		for(int j=0; j<K; ++j) p[j] = rng()%(size+2) - 1;
+		vector<int> actual, expected;
+		tree.stab(p, [&](const vector<int>& bucket) {
+			actual.insert(actual.end(), bucket.begin(), bucket.end());
+		});
+		for(int j=0; j<n; ++j) {
+			if (boxes[j].contains(p)) expected.push_back(ids[j]);
+		}
+		sort(actual.begin(), actual.end());
+		EXPECT_EQ(actual, expected) << p;
+	}
+}
+
+TEST(StabbingTreeTest1D, Random) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		checkRandomStabbing<1>(20, 1 + i%10, rng);
+	}
+}
+
+TEST(StabbingTreeTest2D, Random) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		checkRandomStabbing<2>(12, 1 + i%15, rng);
+	}
+}
+
+TEST(StabbingTreeTest3D, Random) {
+	for(int i=0; i<50; ++i) {
+		mt19937 rng(i);
+		checkRandomStabbing<3>(8, 1 + i%15, rng);
+	}
+}
+
+TEST(StabbingTreeTest2D, Empty) {
+	StabbingTree<2> tree({}, {});
+	int calls = 0;
+	tree.stab({1,1}, [&](const vector<int>&) { ++calls; });
+	EXPECT_EQ(calls, 0);
+}
+
+} // namespace
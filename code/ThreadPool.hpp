@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads for running batches of independent tasks.
+//
+// Several batches may run at the same time, either from different threads or
+// nested inside tasks of other batches. The thread calling `run` always works
+// on its own batch, and idle workers help with the most recently started batch
+// that still has unclaimed tasks. Because every claimed task is being executed
+// by some thread, nested batches cannot deadlock.
+class ThreadPool {
+public:
+	explicit ThreadPool(int threads) {
+		for(int i=1; i<threads; ++i) {
+			workers.emplace_back([this]{ workerLoop(); });
+		}
+	}
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread& t: workers) t.join();
+	}
+
+	// Number of threads executing a batch, including the calling thread.
+	int size() const { return workers.size() + 1; }
+
+	// Calls `task(i)` for each i in [0,n) and returns when all the calls have
+	// finished.
+	template<class F>
+	void run(int n, F&& task) {
+		if (workers.empty() || n <= 1) {
+			for(int i=0; i<n; ++i) task(i);
+			return;
+		}
+		using Task = typename std::remove_reference<F>::type;
+		Batch batch;
+		batch.call = [](void* t, int i) { (*static_cast<Task*>(t))(i); };
+		batch.task = &task;
+		batch.n = n;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			batches.push_back(&batch);
+		}
+		wake.notify_all();
+		work(batch);
+		std::unique_lock<std::mutex> lock(mutex);
+		batches.erase(std::find(batches.begin(), batches.end(), &batch));
+		done.wait(lock, [&]{ return batch.active == 0; });
+	}
+
+	// Pool shared by the whole process, sized by the hardware concurrency.
+	static ThreadPool& global() {
+		static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+		return pool;
+	}
+
+private:
+	struct Batch {
+		void (*call)(void*, int) = nullptr;
+		void* task = nullptr;
+		int n = 0;
+		std::atomic<int> next{0};
+		// Number of worker threads currently working on the batch. Protected
+		// by `mutex`.
+		int active = 0;
+
+		bool hasWork() const { return next < n; }
+	};
+
+	static void work(Batch& batch) {
+		for(int i; (i = batch.next++) < batch.n; ) {
+			batch.call(batch.task, i);
+		}
+	}
+
+	// Returns the most recently started batch with unclaimed tasks. Must be
+	// called with `mutex` held.
+	Batch* findWork() const {
+		for(auto it = batches.rbegin(); it != batches.rend(); ++it) {
+			if ((*it)->hasWork()) return *it;
+		}
+		return nullptr;
+	}
+
+	void workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true) {
+			Batch* batch = nullptr;
+			wake.wait(lock, [&]{ return stopping || (batch = findWork()); });
+			if (stopping) return;
+			++batch->active;
+			lock.unlock();
+			work(*batch);
+			lock.lock();
+			if (--batch->active == 0) done.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	// Batches that have been started and not yet finished by their owner.
+	std::vector<Batch*> batches;
+	bool stopping = false;
+};
@@ -0,0 +1,80 @@
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+	ThreadPool pool(4);
+	vector<int> count(100);
+	pool.run(count.size(), [&](int i) { count[i]++; });
+	EXPECT_EQ(count, vector<int>(100, 1));
+}
+
+TEST(ThreadPoolTest, ManyBatches) {
+	ThreadPool pool(3);
+	atomic<int> sum{0};
+	for(int i=0; i<1000; ++i) {
+		pool.run(5, [&](int j) { sum += j; });
+	}
+	EXPECT_EQ(sum, 10000);
+}
+
+TEST(ThreadPoolTest, NestedRun) {
+	ThreadPool pool(4);
+	vector<vector<int>> res(4, vector<int>(8));
+	pool.run(4, [&](int i) {
+		pool.run(8, [&](int j) { res[i][j] = i*j; });
+	});
+	for(int i=0; i<4; ++i) {
+		for(int j=0; j<8; ++j) {
+			EXPECT_EQ(res[i][j], i*j);
+		}
+	}
+}
+
+TEST(ThreadPoolTest, DeeplyNestedRun) {
+	ThreadPool pool(4);
+	atomic<int> leaves{0};
+	function<void(int)> rec = [&](int depth) {
+		if (depth == 0) {
+			leaves++;
+			return;
+		}
+		pool.run(2, [&](int) { rec(depth-1); });
+	};
+	rec(10);
+	EXPECT_EQ(leaves, 1<<10);
+}
+
+TEST(ThreadPoolTest, ConcurrentCallers) {
+	ThreadPool pool(4);
+	atomic<int> sum{0};
+	vector<thread> callers;
+	for(int i=0; i<4; ++i) {
+		callers.emplace_back([&] {
+			for(int j=0; j<100; ++j) {
+				pool.run(10, [&](int k) { sum += k; });
+			}
+		});
+	}
+	for(thread& t: callers) t.join();
+	EXPECT_EQ(sum, 4*100*45);
+}
+
+TEST(ThreadPoolTest, SingleThread) {
+	ThreadPool pool(1);
+	EXPECT_EQ(pool.size(), 1);
+	int sum = 0;
+	pool.run(10, [&](int i) { sum += i; });
+	EXPECT_EQ(sum, 45);
+}
+
+} // namespace
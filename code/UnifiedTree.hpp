@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Box.hpp"
+#include "Span.hpp"
+#include "ThreadPool.hpp"
 #include "TreeStructure.hpp"
 #include "print.hpp"
 #include "util.hpp"
@@ -8,7 +10,9 @@
 #include <array>
 #include <bitset>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 // D-dimensional unified segment tree storing nodes of type T.
@@ -34,6 +38,10 @@ class UnifiedTree {
 public:
 	// Index identifying a single internal node.
 	using Index = std::array<int, D>;
+	// Bitmask with a bit for each box of a bulk operation.
+	using BoxMask = uint64_t;
+	// Maximum number of boxes in a single bulk operation.
+	static constexpr int MAX_BULK = 64;
 
 	UnifiedTree(Index sizes) {
 		int total = 1;
@@ -51,11 +59,37 @@ public:
 		addRec(0, 0, 0, box, value);
 	}
 
+	// Adds all `boxes` with the same `value`. Equivalent to calling `add` for
+	// each box, but the boxes share a single traversal of the tree, and only
+	// the subtrees touched by some box are visited. At most MAX_BULK boxes.
+	void add(Span<const Box<D>> boxes, const T& value) {
+		BoxMask active = ~BoxMask(0);
+		bulkTraverse(boxes, active, [&](int index, Mask covered, int) {
+			addToItem(index, covered, value);
+			return false;
+		});
+	}
+
 	// Find if any added box intersects with the given box. Time complexity O(log^D n).
 	bool check(const Box<D>& box) const {
 		return checkRec(0, 0, 0, box);
 	}
 
+	// Returns a mask where bit i is set if any added box intersects
+	// `boxes[i]`. Equivalent to calling `check` for each box, but shares the
+	// traversal between the boxes and stops following boxes once they are
+	// known to intersect. At most MAX_BULK boxes.
+	BoxMask check(Span<const Box<D>> boxes) const {
+		BoxMask active = ~BoxMask(0);
+		BoxMask res = 0;
+		bulkTraverse(boxes, active, [&](int index, Mask covered, int box) {
+			if (!data[index].hasData[covered ^ ALL_MASK]) return false;
+			res |= BoxMask(1) << box;
+			return true;
+		});
+		return res;
+	}
+
 	// Clears the region defines by a given box from the tree. Time complexity
 	// O(n^(D-1)*log n+k) where k is the number of cleared internal nodes.
 	void remove(Box<D> box) {
@@ -71,6 +105,20 @@ public:
 		removeInSubtree(ones, 0, box, visitor);
 	}
 
+	// Same as `remove`, but subtrees covering at least `minParallelSize`
+	// leaf cells are split in half and the halves are cleared in parallel on
+	// `pool`. The halves touch disjoint sets of nodes. Visitor calls from the
+	// second half are buffered and replayed after the first half finishes, so
+	// `visitor` is called for the same nodes in the same order as by `remove`
+	// and never concurrently.
+	template<class V>
+	void removeParallel(Box<D> box, V&& visitor, ThreadPool& pool, long minParallelSize) {
+		for(int i=0; i<D; ++i) if (box[i].size()==0) return;
+		Index ones;
+		for(int i=0; i<D; ++i) ones[i]=1;
+		removeInSubtree(ones, 0, box, visitor, &pool, minParallelSize);
+	}
+
 	Index getSize() const { return size; }
 
 	// Returns the box represented by internal node `index`.
@@ -122,16 +170,7 @@ private:
 	// `axis`.
 	void addRec(int index, int axis, Mask covered, const Box<D>& box, const T& value) {
 		if (axis == D) {
-			Item& x = data[index];
-			if (covered == ALL_MASK && !x.hasData[ALL_MASK]) {
-				assignItem(index, value);
-			} else {
-				for(Mask i=0; i<1<<D; ++i) {
-					if (i == (i & covered)) {
-						x.hasData.set(i);
-					}
-				}
-			}
+			addToItem(index, covered, value);
 			return;
 		}
 		int s = size[axis];
@@ -161,6 +200,90 @@ private:
 		}
 	}
 
+	// Marks the node `index` as covered by an added box along the axes in
+	// `covered`.
+	void addToItem(int index, Mask covered, const T& value) {
+		Item& x = data[index];
+		if (covered == ALL_MASK && !x.hasData[ALL_MASK]) {
+			assignItem(index, value);
+		} else {
+			for(Mask i=0; i<1<<D; ++i) {
+				if (i == (i & covered)) {
+					x.hasData.set(i);
+				}
+			}
+		}
+	}
+
+	// State of a single box during a bulk traversal.
+	struct BulkItem {
+		int box;
+		Mask covered;
+	};
+
+	// Visits the same (node, covered) pairs as `addRec` and `checkRec` would
+	// for each box of `boxes`, but top-down and sharing the traversal between
+	// the boxes. Calls `visit(index, covered, box)` for each visited node of
+	// each box whose bit is set in `active`. If `visit` returns true, the bit
+	// of the box is cleared and the box is not followed any further.
+	template<class V>
+	void bulkTraverse(Span<const Box<D>> boxes, BoxMask& active, V&& visit) const {
+		assert(boxes.size() <= MAX_BULK);
+		BulkItem items[MAX_BULK];
+		int n = 0;
+		for(int i=0; i<boxes.size(); ++i) {
+			bool empty = false;
+			for(int j=0; j<D; ++j) empty |= boxes[i][j].size() == 0;
+			if (!empty) items[n++] = {i, 0};
+		}
+		bulkRec(0, 0, items, n, boxes, active, visit);
+	}
+
+	template<class V>
+	void bulkRec(int index, int axis, const BulkItem* items, int n,
+			Span<const Box<D>> boxes, BoxMask& active, V& visit) const {
+		if (axis == D) {
+			for(int i=0; i<n; ++i) {
+				int box = items[i].box;
+				if ((active >> box & 1) && visit(index, items[i].covered, box)) {
+					active &= ~(BoxMask(1) << box);
+				}
+			}
+			return;
+		}
+		bulkNode(index, axis, 1, items, n, boxes, active, visit);
+	}
+
+	// Handles the boxes intersecting `node` of the 1-dimensional segment tree
+	// of `axis`. Boxes covering the node are passed to the next axis with
+	// the axis marked covered. Boxes partially intersecting the node are
+	// passed to the next axis as is, and to the child nodes.
+	template<class V>
+	void bulkNode(int index, int axis, int node, const BulkItem* items, int n,
+			Span<const Box<D>> boxes, BoxMask& active, V& visit) const {
+		Range range = rangeForIndex(axis, node);
+		BulkItem inner[MAX_BULK], partial[MAX_BULK];
+		int innerCount = 0, partialCount = 0;
+		for(int i=0; i<n; ++i) {
+			const BulkItem& item = items[i];
+			if (!(active >> item.box & 1)) continue;
+			Range r = boxes[item.box][axis];
+			if (!r.intersects(range)) continue;
+			if (r.contains(range)) {
+				inner[innerCount++] = {item.box, item.covered | (1U << axis)};
+			} else {
+				inner[innerCount++] = item;
+				partial[partialCount++] = item;
+			}
+		}
+		if (!innerCount) return;
+		bulkRec(index + stepSize[axis]*node, axis+1, inner, innerCount, boxes, active, visit);
+		if (partialCount && node < size[axis]) {
+			bulkNode(index, axis, 2*node, partial, partialCount, boxes, active, visit);
+			bulkNode(index, axis, 2*node+1, partial, partialCount, boxes, active, visit);
+		}
+	}
+
 	void assignItem(int index, const T& item) {
 		if (data[index].hasData[ALL_MASK]) return;
 		data[index].data = item;
@@ -205,8 +328,12 @@ private:
 	// current node along `axis` and recursively clear the half-sized subtrees.
 	//
 	// Complexity: O(n^(D-axis-1)*log n+k), where k is the number of cleared nodes.
+	//
+	// If `pool` is given, the two halves of subtrees with at least
+	// `minParallelSize` leaf cells are cleared in parallel.
 	template<class V>
-	void removeInSubtree(Index index, int axis, const Box<D>& box, V&& visitor) {
+	void removeInSubtree(Index index, int axis, const Box<D>& box, V&& visitor,
+			ThreadPool* pool = nullptr, long minParallelSize = 0) {
 		int totalIndex = computeIndex(index);
 		Item& item = data[totalIndex];
 		if (!item.hasData[0]) return;
@@ -223,11 +350,26 @@ private:
 		if (isParent) {
 			propagateInSubtree(index, axis+1, box, axis);
 		}
-		removeInSubtree(index, axis+1, box, visitor);
+		removeInSubtree(index, axis+1, box, visitor, pool, minParallelSize);
 		int i = index[axis];
 		if (i < size[axis]) {
-			removeInSubtree(withIndex(index, axis, 2*i), axis, box, visitor);
-			removeInSubtree(withIndex(index, axis, 2*i+1), axis, box, visitor);
+			Index left = withIndex(index, axis, 2*i);
+			Index right = withIndex(index, axis, 2*i+1);
+			if (pool && subtreeCells(axis, i) >= minParallelSize) {
+				std::vector<std::pair<Index, T>> rightVisits;
+				VisitBuffer buffer{&rightVisits};
+				pool->run(2, [&](int half) {
+					if (half == 0) {
+						removeInSubtree(left, axis, box, visitor, pool, minParallelSize);
+					} else {
+						removeInSubtree(right, axis, box, buffer, pool, minParallelSize);
+					}
+				});
+				for(const auto& v: rightVisits) visitor(v.first, v.second);
+			} else {
+				removeInSubtree(left, axis, box, visitor, pool, minParallelSize);
+				removeInSubtree(right, axis, box, visitor, pool, minParallelSize);
+			}
 		}
 		if (isParent) {
 			computeChildData(index, axis+1, box);
@@ -314,6 +456,22 @@ private:
 		}
 	}
 
+	// Visitor collecting the visited nodes for replaying them later.
+	struct VisitBuffer {
+		std::vector<std::pair<Index, T>>* visits;
+		void operator()(const Index& index, const T& value) const {
+			visits->emplace_back(index, value);
+		}
+	};
+
+	// Number of leaf cells below the subtree rooted at node `i` along `axis`
+	// when the later axes are not split.
+	long subtreeCells(int axis, int i) const {
+		long res = rangeForIndex(axis, i).size();
+		for(int j=axis+1; j<D; ++j) res *= size[j];
+		return res;
+	}
+
 	static Index withIndex(Index index, int axis, int x) {
 		index[axis] = x;
 		return index;
@@ -320,4 +320,108 @@ TEST(UnifiedTreeTest3D, RandomAddRemove32) {
 	}
 }
 
+template<int D>
+vector<Box<D>> genRandomBoxes(int size, int n, mt19937& rng) {
+	vector<Box<D>> boxes;
+	for(const Operation<D>& op: genRandomOps<D>(size, n, {OType::ADD}, rng)) {
+		boxes.push_back(op.box);
+	}
+	return boxes;
+}
+
+// Adds random batches of boxes to one tree by bulk adds and to another by
+// single adds, and verifies that bulk and single checks agree and that
+// removing everything visits the same nodes.
+template<int D>
+void runBulkOps(int size, int batches, mt19937& rng) {
+	using Tree = UnifiedTree<int, D>;
+	typename Tree::Index sz;
+	for(int i=0; i<D; ++i) sz[i] = size;
+	Tree bulk(sz), single(sz);
+	for(int b=0; b<batches; ++b) {
+		vector<Box<D>> boxes = genRandomBoxes<D>(size, 1 + rng()%10, rng);
+		bulk.add(boxes, b);
+		for(const Box<D>& box: boxes) single.add(box, b);
+
+		vector<Box<D>> queries = genRandomBoxes<D>(size, 1 + rng()%64, rng);
+		auto mask = bulk.check(queries);
+		for(size_t i=0; i<queries.size(); ++i) {
+			EXPECT_EQ(mask>>i & 1, single.check(queries[i])) << queries[i];
+		}
+	}
+	vector<pair<typename Tree::Index, int>> bulkRemoved, singleRemoved;
+	Box<D> all;
+	for(int i=0; i<D; ++i) all[i] = {0, size};
+	bulk.remove(all, [&](const typename Tree::Index& idx, int x) {
+		bulkRemoved.emplace_back(idx, x);
+	});
+	single.remove(all, [&](const typename Tree::Index& idx, int x) {
+		singleRemoved.emplace_back(idx, x);
+	});
+	EXPECT_EQ(bulkRemoved, singleRemoved);
+}
+
+TEST(UnifiedTreeTest1D, RandomBulk) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		runBulkOps<1>(32, 5, rng);
+	}
+}
+
+TEST(UnifiedTreeTest2D, RandomBulk) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		runBulkOps<2>(16, 5, rng);
+	}
+}
+
+TEST(UnifiedTreeTest3D, RandomBulk) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		runBulkOps<3>(8, 5, rng);
+	}
+}
+
+template<int D>
+void runParallelRemove(int size, int rounds, mt19937& rng) {
+	using Tree = UnifiedTree<int, D>;
+	using Visits = vector<pair<typename Tree::Index, int>>;
+	typename Tree::Index sz;
+	for(int i=0; i<D; ++i) sz[i] = size;
+	Tree parallel(sz), sequential(sz);
+	ThreadPool pool(4);
+	for(int r=0; r<rounds; ++r) {
+		for(const Box<D>& box: genRandomBoxes<D>(size, 1 + rng()%10, rng)) {
+			parallel.add(box, r);
+			sequential.add(box, r);
+		}
+		Box<D> box = genRandomBoxes<D>(size, 1, rng)[0];
+		Visits parallelRemoved, sequentialRemoved;
+		parallel.removeParallel(box, [&](const typename Tree::Index& idx, int x) {
+			parallelRemoved.emplace_back(idx, x);
+		}, pool, 1);
+		sequential.remove(box, [&](const typename Tree::Index& idx, int x) {
+			sequentialRemoved.emplace_back(idx, x);
+		});
+		EXPECT_EQ(parallelRemoved, sequentialRemoved);
+		for(const Box<D>& q: genRandomBoxes<D>(size, 10, rng)) {
+			EXPECT_EQ(parallel.check(q), sequential.check(q)) << q;
+		}
+	}
+}
+
+TEST(UnifiedTreeTest2D, RandomParallelRemove) {
+	for(int i=0; i<50; ++i) {
+		mt19937 rng(i);
+		runParallelRemove<2>(16, 5, rng);
+	}
+}
+
+TEST(UnifiedTreeTest3D, RandomParallelRemove) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		runParallelRemove<3>(8, 5, rng);
+	}
+}
+
 } // namespace
@@ -0,0 +1,124 @@
+#pragma once
+// Contains utility function for computing the union of a collection of `Box`
+// objects as a set of disjoint boxes.
+
+#include "Box.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <vector>
+
+template<int D>
+struct BoxUnion {
+	// Splits the space into slabs along the last axis at the box boundaries,
+	// and computes the union of the cross-section of each slab recursively.
+	// Consecutive slabs with equal cross-sections are merged into the same
+	// boxes.
+	static std::vector<Box<D>> compute(std::vector<Box<D>> boxes) {
+		std::vector<int> coords;
+		for(const Box<D>& b: boxes) {
+			if (b[D-1].empty()) continue;
+			coords.push_back(b[D-1].from);
+			coords.push_back(b[D-1].to);
+		}
+		sortUnique(coords);
+		std::sort(boxes.begin(), boxes.end(), [](const Box<D>& a, const Box<D>& b) {
+			return a[D-1].from < b[D-1].from;
+		});
+
+		std::vector<Box<D>> res;
+		std::vector<Box<D-1>> prevSection;
+		// Indices in `res` of the boxes of `prevSection`.
+		size_t prevBegin = 0;
+		int prevTo = -1;
+		std::vector<int> active;
+		size_t next = 0;
+		for(size_t i=0; i+1<coords.size(); ++i) {
+			Range slab = {coords[i], coords[i+1]};
+			active.erase(std::remove_if(active.begin(), active.end(), [&](int j) {
+				return boxes[j][D-1].to <= slab.from;
+			}), active.end());
+			for(; next<boxes.size() && boxes[next][D-1].from <= slab.from; ++next) {
+				if (boxes[next][D-1].to > slab.from) active.push_back(next);
+			}
+			std::vector<Box<D-1>> section;
+			for(int j: active) section.push_back(boxes[j].project());
+			section = BoxUnion<D-1>::compute(section);
+			std::sort(section.begin(), section.end());
+			if (prevTo == slab.from && section == prevSection) {
+				for(size_t j=prevBegin; j<res.size(); ++j) res[j][D-1].to = slab.to;
+			} else {
+				prevBegin = res.size();
+				for(const Box<D-1>& s: section) {
+					Box<D> b;
+					for(int j=0; j<D-1; ++j) b[j] = s[j];
+					b[D-1] = slab;
+					res.push_back(b);
+				}
+				prevSection = std::move(section);
+			}
+			prevTo = slab.to;
+		}
+		return res;
+	}
+};
+
+template<>
+struct BoxUnion<1> {
+	static std::vector<Box<1>> compute(std::vector<Box<1>> boxes) {
+		std::sort(boxes.begin(), boxes.end());
+		std::vector<Box<1>> res;
+		for(const Box<1>& b: boxes) {
+			if (b[0].empty()) continue;
+			if (!res.empty() && res.back()[0].to >= b[0].from) {
+				res.back()[0].to = std::max(res.back()[0].to, b[0].to);
+			} else {
+				res.push_back(b);
+			}
+		}
+		return res;
+	}
+};
+
+// Returns the union of `boxes` as a set of disjoint boxes. Adjacent boxes are
+// merged along the last axis when their cross-sections are equal, and along
+// the first axis within each cross-section. Empty boxes are ignored.
+template<int D>
+inline std::vector<Box<D>> boxUnion(const std::vector<Box<D>>& boxes) {
+	return BoxUnion<D>::compute(boxes);
+}
+
+// Returns the parts of `box` that are not covered by any of `cover` as a set
+// of disjoint boxes. Cuts the remaining parts of `box` by each covering box in
+// turn, so `cover` should hold only the boxes that intersect `box`.
+template<int D>
+inline std::vector<Box<D>> boxDifference(const Box<D>& box, const std::vector<Box<D>>& cover) {
+	std::vector<Box<D>> parts = {box}, next;
+	for(const Box<D>& c: cover) {
+		next.clear();
+		for(Box<D> p: parts) {
+			if (!p.intersects(c)) {
+				next.push_back(p);
+				continue;
+			}
+			// Splits off the slabs of `p` on both sides of `c` along each
+			// axis, leaving the part inside `c`.
+			for(int i=0; i<D; ++i) {
+				if (p[i].from < c[i].from) {
+					Box<D> slab = p;
+					slab[i].to = c[i].from;
+					next.push_back(slab);
+					p[i].from = c[i].from;
+				}
+				if (p[i].to > c[i].to) {
+					Box<D> slab = p;
+					slab[i].from = c[i].to;
+					next.push_back(slab);
+					p[i].to = c[i].to;
+				}
+			}
+		}
+		parts.swap(next);
+	}
+	return parts;
+}
@@ -0,0 +1,119 @@
+#include "boxUnion.hpp"
+
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+template<int D>
+set<vector<int>> cellsOf(const vector<Box<D>>& boxes, int size) {
+	set<vector<int>> res;
+	vector<int> p(D);
+	int total = 1;
+	for(int i=0; i<D; ++i) total *= size;
+	for(int c=0; c<total; ++c) {
+		for(int i=0, x=c; i<D; ++i, x/=size) p[i] = x%size;
+		for(const Box<D>& b: boxes) {
+			bool in = true;
+			for(int i=0; i<D; ++i) in &= b[i].contains(p[i]);
+			if (in) {
+				res.insert(p);
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+template<int D>
+void checkRandomUnion(int size, int n, mt19937& rng) {
+	vector<Box<D>> boxes(n);
+	for(Box<D>& b: boxes) {
+		for(int i=0; i<D; ++i) {
+			int x = rng()%(size+1), y = rng()%(size+1);
+			b[i] = {min(x,y), max(x,y)};
+		}
+	}
+	vector<Box<D>> res = boxUnion(boxes);
+	EXPECT_EQ(cellsOf(res, size), cellsOf(boxes, size));
+	for(size_t i=0; i<res.size(); ++i) {
+		for(int j=0; j<D; ++j) EXPECT_FALSE(res[i][j].empty()) << res[i];
+		for(size_t j=0; j<i; ++j) {
+			EXPECT_FALSE(res[i].intersects(res[j])) << res[i] << ' ' << res[j];
+		}
+	}
+}
+
+template<int D>
+Box<D> randomBox(int size, mt19937& rng) {
+	Box<D> b;
+	for(int i=0; i<D; ++i) {
+		int x = rng()%size;
+		b[i] = {x, x + 1 + (int)(rng()%(size-x))};
+	}
+	return b;
+}
+
+template<int D>
+void checkRandomDifference(int size, int n, mt19937& rng) {
+	Box<D> box = randomBox<D>(size, rng);
+	vector<Box<D>> cover(n);
+	for(Box<D>& b: cover) b = randomBox<D>(size, rng);
+	vector<Box<D>> res = boxDifference(box, cover);
+	set<vector<int>> expected = cellsOf(vector<Box<D>>{box}, size);
+	for(const vector<int>& p: cellsOf(cover, size)) expected.erase(p);
+	EXPECT_EQ(cellsOf(res, size), expected);
+	for(size_t i=0; i<res.size(); ++i) {
+		for(int j=0; j<D; ++j) EXPECT_FALSE(res[i][j].empty()) << res[i];
+		for(size_t j=0; j<i; ++j) {
+			EXPECT_FALSE(res[i].intersects(res[j])) << res[i] << ' ' << res[j];
+		}
+	}
+}
+
+TEST(BoxUnionTest1D, MergesTouching) {
+	vector<Box<1>> boxes = {{{Range{3,5}}}, {{Range{0,2}}}, {{Range{2,3}}}, {{Range{7,8}}}};
+	vector<Box<1>> expected = {{{Range{0,5}}}, {{Range{7,8}}}};
+	EXPECT_EQ(boxUnion(boxes), expected);
+}
+
+TEST(BoxUnionTest2D, MergesEqualSlabs) {
+	vector<Box<2>> boxes = {{{Range{0,2}, Range{0,1}}}, {{Range{0,2}, Range{1,3}}}};
+	vector<Box<2>> expected = {{{Range{0,2}, Range{0,3}}}};
+	EXPECT_EQ(boxUnion(boxes), expected);
+}
+
+TEST(BoxUnionTest2D, Random) {
+	for(int i=0; i<200; ++i) {
+		mt19937 rng(i);
+		checkRandomUnion<2>(8, 1 + i%10, rng);
+	}
+}
+
+TEST(BoxUnionTest3D, Random) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		checkRandomUnion<3>(6, 1 + i%10, rng);
+	}
+}
+
+TEST(BoxDifferenceTest2D, Random) {
+	for(int i=0; i<200; ++i) {
+		mt19937 rng(i);
+		checkRandomDifference<2>(8, i%6, rng);
+	}
+}
+
+TEST(BoxDifferenceTest3D, Random) {
+	for(int i=0; i<100; ++i) {
+		mt19937 rng(i);
+		checkRandomDifference<3>(6, i%6, rng);
+	}
+}
+
+} // namespace
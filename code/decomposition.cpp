@@ -2,15 +2,19 @@
 
 #include "Box.hpp"
 #include "Span.hpp"
+#include "boxUnion.hpp"
 #include "overlap.hpp"
 #include "util.hpp"
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <numeric>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using namespace std;
@@ -39,6 +43,9 @@ constexpr int Y_AXIS = 1;
 constexpr int UP = 2;
 constexpr int DOWN = 3;
 
+// Number of sweepline events between cancellation checks.
+constexpr size_t CANCEL_CHECK_INTERVAL = 1024;
+
 // Represents a partially built free-space node during the line-sweep
 // algorithm. The x-range and the start y-coordinate are known, but the end
 // y-coordinate is not yet fixed.
@@ -57,7 +64,6 @@ struct DecomposeNode {
 		if (obstacle >= 0) {
 			res.obstacles[DOWN].push_back(obstacle);
 		}
-		cout<<"Creating cell "<<res.box<<' '<<res.links[UP]<<'\n';
 		return res;
 	}
 
@@ -84,7 +90,7 @@ void moveContentsUnordered(vector<T>& to, vector<T>& from) {
 // built.
 class Sweepline {
 public:
-	Sweepline(const ObstacleSet<2>* obstacles): obstacles(*obstacles) {}
+	Sweepline(ObstacleSpan<2> obstacles): obstacles(obstacles) {}
 
 	void handleEvent(const Event& event) {
 		if (event.startObstacle) {
@@ -156,11 +162,10 @@ private:
 			it = nodeSet.erase(it);
 		}
 		DecomposeNode node{totalRange, event.pos, std::move(links), std::move(obstacles)};
-		cout<<"insert to nodeset "<<totalRange<<' '<<event.idx<<'\n';
 		nodeSet.insert(std::move(node));
 	}
 
-	const ObstacleSet<2>& obstacles;
+	ObstacleSpan<2> obstacles;
 
 	set<DecomposeNode, less<>> nodeSet;
 	Decomposition<2> decomposition;
@@ -212,12 +217,12 @@ void addXObstacles(Decomposition<2>& decomposition,
 // in O(n*log n) time. The other dimensions are by a recursive algorithm that
 // uses the 2D algorithm as the base case.
 template<>
-Decomposition<2> decomposeFreeSpace<2>(const ObstacleSet<2>& obstacles) {
+bool tryDecomposeFreeSpace<2>(ObstacleSpan<2> obstacles, const CancelToken& cancel, Decomposition<2>& result) {
 	vector<Event> events;
 	map<pair<int,int>, int> cornerToObstacle;
 	for(int i=0; i<(int)obstacles.size(); ++i) {
 		const auto& obs = obstacles[i];
-		cout<<"obs "<<obs<<' '<<obs.box[X_AXIS].size()<<'\n';
+		if (obs.direction < 0) continue;
 		if (obs.box[X_AXIS].size() == 0) {
 			cornerToObstacle[{obs.box[X_AXIS].from, obs.box[Y_AXIS].from}] = i;
 			cornerToObstacle[{obs.box[X_AXIS].to, obs.box[Y_AXIS].from}] = i;
@@ -227,16 +232,17 @@ Decomposition<2> decomposeFreeSpace<2>(const ObstacleSet<2>& obstacles) {
 	}
 	sort(events.begin(), events.end());
 
-	Sweepline sweepline(&obstacles);
-	for(Event event : events) {
-		sweepline.handleEvent(event);
+	Sweepline sweepline(obstacles);
+	for(size_t i=0; i<events.size(); ++i) {
+		if (i % CANCEL_CHECK_INTERVAL == 0 && cancel.stopRequested()) return false;
+		sweepline.handleEvent(events[i]);
 	}
-	Decomposition<2> decomposition = std::move(sweepline.result());
+	result = std::move(sweepline.result());
 
-	addReverseLinks(decomposition);
-	addXObstacles(decomposition, cornerToObstacle);
-	cleanLinks(decomposition);
-	return decomposition;
+	addReverseLinks(result);
+	addXObstacles(result, cornerToObstacle);
+	cleanLinks(result);
+	return true;
 }
 
 template<int D>
@@ -256,20 +262,39 @@ struct IndexedBoxes {
 // (D-1)-dimensional decomposition of the cross-section recursively. The
 // (D-1)-dimensional free-space rectangles are then assigned with the
 // additional dimension and linked in the D-axis as needed.
+//
+// The obstacles are borrowed from the caller. The obstacles crossing the
+// sweep plane are tracked incrementally, so each depth only projects the
+// obstacles at that depth into a reused cross-section buffer.
 template<int D>
 class SweepState {
 public:
-	SweepState(ObstacleSet<D> obstacles): obstacles(obstacles) {}
+	SweepState(ObstacleSpan<D> obstacles): obstacles(obstacles) {
+		for(int i=0; i<obstacles.size(); ++i) {
+			const Obstacle<D>& obs = obstacles[i];
+			if (obs.direction >= 0 && !obs.box[D-1].empty()) byStart.push_back(i);
+		}
+		stable_sort(byStart.begin(), byStart.end(), [&](int a, int b) {
+			return obstacles[a].box[D-1].from < obstacles[b].box[D-1].from;
+		});
+	}
 
+	// Must be called with increasing `z`.
 	void advanceToDepth(int z) {
-		ObstacleSet<D-1> crossSection;
-		vector<int> obsIndex;
-		for(size_t i=0; i<obstacles.size(); ++i) {
-			const Obstacle<D>& obs = obstacles[i];
-			if (obs.box[D-1].contains(z)) {
-				crossSection.push_back({obs.box.project(), obs.direction});
-				obsIndex.push_back(i);
-			}
+		obsIndex.erase(remove_if(obsIndex.begin(), obsIndex.end(), [&](int i) {
+			return obstacles[i].box[D-1].to <= z;
+		}), obsIndex.end());
+		size_t oldCount = obsIndex.size();
+		for(; nextStart < byStart.size() && obstacles[byStart[nextStart]].box[D-1].from <= z; ++nextStart) {
+			int i = byStart[nextStart];
+			if (obstacles[i].box[D-1].to > z) obsIndex.push_back(i);
+		}
+		sort(obsIndex.begin() + oldCount, obsIndex.end());
+		inplace_merge(obsIndex.begin(), obsIndex.begin() + oldCount, obsIndex.end());
+
+		crossSection.clear();
+		for(int i: obsIndex) {
+			crossSection.push_back({obstacles[i].box.project(), obstacles[i].direction});
 		}
 		Decomposition<D-1> curPlane = decomposeFreeSpace(crossSection);
 		vector<int> planeIndex(curPlane.size());
@@ -286,14 +311,6 @@ public:
 				}
 			}
 		}
-		vector<int> newObs;
-		set_difference(prevObsIndex.begin(), prevObsIndex.end(),
-				obsIndex.begin(), obsIndex.end(),
-				back_inserter(newObs));
-		vector<Box<D-1>> newObsBox;
-		for(int i: newObs) newObsBox.push_back(obstacles[i].box.project());
-
-		prevObsIndex = obsIndex;
 	}
 
 	Decomposition<3>& result() { return decomposition; }
@@ -341,33 +358,40 @@ private:
 		return box;
 	}
 
-	ObstacleSet<D> obstacles;
+	ObstacleSpan<D> obstacles;
+	// Indices of the obstacles crossing some sweep plane, sorted by the
+	// start of their range on the sweep axis.
+	vector<int> byStart;
+	// Number of obstacles of `byStart` that the sweep plane has reached.
+	size_t nextStart = 0;
+	// Indices of the obstacles crossing the current sweep plane, in
+	// increasing order, and their projections to the plane.
+	vector<int> obsIndex;
+	ObstacleSet<D-1> crossSection;
 
 	Decomposition<D> decomposition;
-	Decomposition<D> activeCells;
 
 	map<Box<D-1>, int> activeIndex;
-	vector<int> prevObsIndex;
 };
 
 template<int D, class T>
-vector<Box<D-1>> getProjBoxesT(const T& items, Span<const int> idx) {
+vector<Box<D-1>> getProjBoxesT(const T& items, Span<const int> idx, int axis) {
 	vector<Box<D-1>> boxes;
 	boxes.reserve(idx.size());
 	for(int i: idx) {
-		boxes.push_back(items[i].box.project());
+		boxes.push_back(items[i].box.project(axis));
 	}
 	return boxes;
 }
 
 template<int D>
-vector<Box<D-1>> getProjBoxes(const Decomposition<D>& items, Span<const int> idx) {
-	return getProjBoxesT<D>(items, idx);
+vector<Box<D-1>> getProjBoxes(const Decomposition<D>& items, Span<const int> idx, int axis) {
+	return getProjBoxesT<D>(items, idx, axis);
 }
 
 template<int D>
-vector<Box<D-1>> getProjBoxes(const ObstacleSet<D>& items, Span<const int> idx) {
-	return getProjBoxesT<D>(items, idx);
+vector<Box<D-1>> getProjBoxes(ObstacleSpan<D> items, Span<const int> idx, int axis) {
+	return getProjBoxesT<D>(items, idx, axis);
 }
 
 // Modifies `decomposition` to add missing links in direction `axis`.
@@ -376,7 +400,7 @@ vector<Box<D-1>> getProjBoxes(const ObstacleSet<D>& items, Span<const int> idx)
 // computes (D-1)-dimensional intersections between the cells starting and
 // ending at the current sweep plane position.
 template<int D>
-void computeLinksInDir(Decomposition<D>& decomposition, const ObstacleSet<D>& obstacles, int axis) {
+void computeLinksInDir(Decomposition<D>& decomposition, ObstacleSpan<D> obstacles, int axis) {
 	map<int, vector<int>> decFrom;
 	map<int, vector<int>> decTo;
 	map<int, vector<int>> obsFrom;
@@ -389,10 +413,10 @@ void computeLinksInDir(Decomposition<D>& decomposition, const ObstacleSet<D>& ob
 		zs.push_back(r.from);
 		zs.push_back(r.to);
 	}
-	for(size_t i=0; i<obstacles.size(); ++i) {
+	for(int i=0; i<obstacles.size(); ++i) {
 		const Obstacle<D>& obs = obstacles[i];
 		const Range& r = obs.box[axis];
-		if (r.size() != 0) continue;
+		if (obs.direction < 0 || r.size() != 0) continue;
 		auto& m = obs.direction&1 ? obsTo : obsFrom;
 		m[r.from].push_back(i);
 		zs.push_back(r.from);
@@ -401,17 +425,17 @@ void computeLinksInDir(Decomposition<D>& decomposition, const ObstacleSet<D>& ob
 	for(int z: zs) {
 		const auto& dt = decTo[z];
 		const auto& df = decFrom[z];
-		for(auto p : overlappingBoxes(getProjBoxes(decomposition, dt), getProjBoxes(decomposition, df))) {
+		for(auto p : overlappingBoxes(getProjBoxes(decomposition, dt, axis), getProjBoxes(decomposition, df, axis))) {
 			int a = dt[p.first], b = df[p.second];
 			decomposition[a].links[2*axis+1].push_back(b);
 			decomposition[b].links[2*axis].push_back(a);
 		}
 		const auto& ot = obsTo[z];
 		const auto& of = obsFrom[z];
-		for(auto p : overlappingBoxes(getProjBoxes(decomposition, dt), getProjBoxes(obstacles, of))) {
+		for(auto p : overlappingBoxes(getProjBoxes(decomposition, dt, axis), getProjBoxes(obstacles, of, axis))) {
 			decomposition[dt[p.first]].obstacles[2*axis+1].push_back(of[p.second]);
 		}
-		for(auto p : overlappingBoxes(getProjBoxes(decomposition, df), getProjBoxes(obstacles, ot))) {
+		for(auto p : overlappingBoxes(getProjBoxes(decomposition, df, axis), getProjBoxes(obstacles, ot, axis))) {
 			decomposition[df[p.first]].obstacles[2*axis].push_back(ot[p.second]);
 		}
 	}
@@ -422,10 +446,10 @@ void computeLinksInDir(Decomposition<D>& decomposition, const ObstacleSet<D>& ob
 // of the obstacles, and adding the D-dimension to the resulting free space
 // cells and computing connections between them.
 template<int D>
-Decomposition<D> decomposeFreeSpace(const ObstacleSet<D>& obstacles) {
+bool tryDecomposeFreeSpace(ObstacleSpan<D> obstacles, const CancelToken& cancel, Decomposition<D>& result) {
 	vector<int> depths;
 	for(const auto& obs: obstacles) {
-		if (obs.box[D-1].size() == 0) {
+		if (obs.direction >= 0 && obs.box[D-1].size() == 0) {
 			depths.push_back(obs.box[D-1].from);
 		}
 	}
@@ -433,13 +457,642 @@ Decomposition<D> decomposeFreeSpace(const ObstacleSet<D>& obstacles) {
 
 	SweepState<D> state(obstacles);
 	for(int z: depths) {
+		if (cancel.stopRequested()) return false;
 		state.advanceToDepth(z);
 	}
-	Decomposition<D> decomposition = std::move(state.result());
-	computeLinksInDir(decomposition, obstacles, D-1);
-	cleanLinks(decomposition);
+	result = std::move(state.result());
+	computeLinksInDir(result, obstacles, D-1);
+	cleanLinks(result);
+	return true;
+}
+
+template<int D>
+Decomposition<D> decomposeFreeSpace(ObstacleSpan<D> obstacles) {
+	Decomposition<D> decomposition;
+	tryDecomposeFreeSpace(obstacles, CancelToken(), decomposition);
 	return decomposition;
 }
 
+template<int D>
+vector<int> connectedComponents(const Decomposition<D>& decomposition) {
+	vector<int> res(decomposition.size(), -1);
+	vector<int> stack;
+	int count = 0;
+	for(size_t i=0; i<decomposition.size(); ++i) {
+		if (res[i] >= 0) continue;
+		res[i] = count;
+		stack.push_back(i);
+		while(!stack.empty()) {
+			int cur = stack.back();
+			stack.pop_back();
+			for(const vector<int>& links: decomposition[cur].links) {
+				for(int next: links) {
+					if (res[next] >= 0) continue;
+					res[next] = count;
+					stack.push_back(next);
+				}
+			}
+		}
+		++count;
+	}
+	return res;
+}
+
+namespace {
+
+// Calls `f(next)` for the cells linked to `cell`.
+template<int D, class F>
+void forLinks(const Decomposition<D>& decomposition, int cell, F&& f) {
+	for(const vector<int>& links: decomposition[cell].links) {
+		for(int next: links) f(next);
+	}
+}
+
+// Relabels the cells with the sorted labels of `group` to one of them, where
+// the cells of all the labels are joined into one component by the repaired
+// cells and `seeds` contains cells of each label next to them. The cells of
+// each label are searched in turns, and the search stops when a single label
+// is left, whose cells keep their label. Returns that label.
+template<int D>
+int joinLabels(const Decomposition<D>& decomposition, const vector<int>& group, const vector<int>& seeds,
+		vector<int>& components) {
+	vector<vector<int>> stacks(group.size()), visited(group.size());
+	unordered_set<int> seen;
+	for(int cell: seeds) {
+		int k = lower_bound(group.begin(), group.end(), components[cell]) - group.begin();
+		if (seen.insert(cell).second) {
+			stacks[k].push_back(cell);
+			visited[k].push_back(cell);
+		}
+	}
+	vector<int> live(group.size());
+	iota(live.begin(), live.end(), 0);
+	while(live.size() > 1) {
+		vector<int> next;
+		for(int k: live) {
+			if (stacks[k].empty()) continue;
+			int cell = stacks[k].back();
+			stacks[k].pop_back();
+			forLinks(decomposition, cell, [&](int j) {
+				if (components[j] == group[k] && seen.insert(j).second) {
+					stacks[k].push_back(j);
+					visited[k].push_back(j);
+				}
+			});
+			next.push_back(k);
+		}
+		if (next.empty()) next.push_back(live.back());
+		live.swap(next);
+	}
+	int label = group[live[0]];
+	for(size_t k=0; k<group.size(); ++k) {
+		if ((int)k == live[0]) continue;
+		for(int cell: visited[k]) components[cell] = label;
+	}
+	return label;
+}
+
+} // namespace
+
+// Starts a search from each repaired cell, and joins the searches of linked
+// repaired cells. Each search then walks the cells outside the repaired ones
+// in turns with the others, and two searches reaching a common cell are
+// joined. The links outside the repaired cells are unchanged, so a search
+// that runs out of cells has found a whole component, which gets a new
+// label. The searches stop when a single one is left, whose component keeps
+// an old label. Only the components split off by the update are walked in
+// full, and each search walks about as many cells as the smaller ones.
+template<int D>
+void updateComponents(const Decomposition<D>& decomposition, const vector<int>& repaired,
+		vector<int>& components, int& labelCount) {
+	// Search of each visited cell, possibly joined to another search.
+	unordered_map<int, int> owner;
+	// Union-find over the searches, and the cells left to visit by each root.
+	vector<int> parent;
+	vector<vector<int>> stacks;
+	auto root = [&](int s) {
+		while(parent[s] != s) s = parent[s] = parent[parent[s]];
+		return s;
+	};
+	auto visit = [&](int cell, int s) {
+		s = root(s);
+		auto it = owner.find(cell);
+		if (it == owner.end()) {
+			owner[cell] = s;
+			stacks[s].push_back(cell);
+			return;
+		}
+		int t = root(it->second);
+		if (s == t) return;
+		if (stacks[s].size() < stacks[t].size()) swap(s, t);
+		parent[t] = s;
+		moveAppend(stacks[s], stacks[t]);
+	};
+	for(int cell: repaired) {
+		owner[cell] = parent.size();
+		parent.push_back(parent.size());
+		stacks.emplace_back();
+	}
+	for(int cell: repaired) {
+		forLinks(decomposition, cell, [&](int next) { visit(next, owner[cell]); });
+	}
+	vector<int> live;
+	for(size_t s=0; s<parent.size(); ++s) {
+		if (root(s) == (int)s && !stacks[s].empty()) live.push_back(s);
+	}
+	while(live.size() > 1) {
+		for(int s: live) {
+			if (root(s) != s || stacks[s].empty()) continue;
+			int cell = stacks[s].back();
+			stacks[s].pop_back();
+			forLinks(decomposition, cell, [&](int next) { visit(next, s); });
+		}
+		vector<int> next;
+		for(int s: live) {
+			if (root(s) == s && !stacks[s].empty()) next.push_back(s);
+		}
+		live.swap(next);
+	}
+
+	// Label of each finished search, and the old labels around the
+	// unfinished one with the cells they were found at.
+	unordered_map<int, int> newLabels;
+	vector<int> group, seeds;
+	for(const auto& item: owner) {
+		int cell = item.first, s = root(item.second);
+		if (!stacks[s].empty()) {
+			if (components[cell] >= 0) {
+				group.push_back(components[cell]);
+				seeds.push_back(cell);
+			}
+			continue;
+		}
+		auto it = newLabels.find(s);
+		if (it == newLabels.end()) it = newLabels.emplace(s, labelCount++).first;
+		components[cell] = it->second;
+	}
+	if (live.empty()) return;
+	sortUnique(group);
+	int label = joinLabels(decomposition, group, seeds, components);
+	for(const auto& item: owner) {
+		if (components[item.first] < 0) components[item.first] = label;
+	}
+}
+
+namespace {
+
+template<int D>
+void extendBox(Box<D>& box, const Box<D>& b) {
+	for(int i=0; i<D; ++i) box[i] = box[i].union_(b[i]);
+}
+
+// Returns obstacles that close the free space of the sorted `cells` where it
+// continues to cells outside them. Adds the outside cells to `outside`.
+template<int D>
+ObstacleSet<D> regionWalls(const Decomposition<D>& decomposition, const vector<int>& cells, vector<int>& outside) {
+	// Walls by their direction and position.
+	map<pair<int,int>, vector<Box<D-1>>> walls;
+	for(int i: cells) {
+		const Cell<D>& cell = decomposition[i];
+		for(int dir=0; dir<2*D; ++dir) {
+			int axis = dir/2;
+			for(int j: cell.links[dir]) {
+				if (binary_search(cells.begin(), cells.end(), j)) continue;
+				Box<D-1> wall = cell.box.project(axis);
+				Box<D-1> other = decomposition[j].box.project(axis);
+				for(int k=0; k<D-1; ++k) wall[k] = wall[k].intersection(other[k]);
+				walls[{dir, cell.box[axis][dir&1]}].push_back(wall);
+				outside.push_back(j);
+			}
+		}
+	}
+	sortUnique(outside);
+	ObstacleSet<D> res;
+	for(const auto& item: walls) {
+		int dir = item.first.first, axis = dir/2, pos = item.first.second;
+		for(const Box<D-1>& wall: boxUnion(item.second)) {
+			Obstacle<D> obs;
+			for(int k=0, j=0; k<D; ++k) obs.box[k] = k == axis ? Range{pos, pos} : wall[j++];
+			obs.direction = dir^1;
+			res.push_back(obs);
+		}
+	}
+	return res;
+}
+
+// Adds to `res` the parts of the obstacles of the sorted `cells` that bound
+// them, except for the obstacles in the sorted `skip`, and the index in
+// `obstacles` of each part to `index`.
+template<int D>
+void boundingObstacles(const ObstacleSet<D>& obstacles, const Decomposition<D>& decomposition,
+		const vector<int>& cells, const vector<int>& skip, ObstacleSet<D>& res, vector<int>& index) {
+	// Parts of each obstacle with the obstacle axis removed.
+	map<int, vector<Box<D-1>>> parts;
+	for(int i: cells) {
+		const Cell<D>& cell = decomposition[i];
+		for(int dir=0; dir<2*D; ++dir) {
+			for(int j: cell.obstacles[dir]) {
+				if (obstacles[j].direction < 0 || binary_search(skip.begin(), skip.end(), j)) continue;
+				Box<D-1> part = obstacles[j].box.project(dir/2);
+				Box<D-1> face = cell.box.project(dir/2);
+				for(int k=0; k<D-1; ++k) part[k] = part[k].intersection(face[k]);
+				parts[j].push_back(part);
+			}
+		}
+	}
+	for(const auto& item: parts) {
+		const Obstacle<D>& obs = obstacles[item.first];
+		int axis = obs.direction/2;
+		for(const Box<D-1>& part: boxUnion(item.second)) {
+			Obstacle<D> o = obs;
+			for(int k=0, j=0; k<D; ++k) {
+				if (k != axis) o.box[k] = part[j++];
+			}
+			res.push_back(o);
+			index.push_back(item.first);
+		}
+	}
+}
+
+// Keeps a label per cell aligned with a decomposition being repaired, and
+// records the cells decomposed again. Does nothing without `labels`.
+struct RepairLog {
+	// Label of each cell, which moves with its cell. The new cells get -1.
+	vector<int>* labels = nullptr;
+	// Indices of the new cells.
+	vector<int>* repaired = nullptr;
+
+	// Records a new cell at index `cell`, which may be the end of the
+	// decomposition.
+	void newCell(int cell) {
+		if (!labels) return;
+		if (cell == (int)labels->size()) {
+			labels->push_back(-1);
+		} else if ((*labels)[cell] >= 0) {
+			(*labels)[cell] = -1;
+		} else {
+			return;
+		}
+		repaired->push_back(cell);
+	}
+	// Records that the cell at index `to` is dropped and the last cell is
+	// moved to its place.
+	void moveLast(int to) {
+		if (!labels) return;
+		vector<int>& l = *labels;
+		int from = l.size() - 1;
+		if (l[to] < 0) repaired->erase(find(repaired->begin(), repaired->end(), to));
+		if (from != to) {
+			if (l[from] < 0) *find(repaired->begin(), repaired->end(), from) = to;
+			l[to] = l[from];
+		}
+		l.pop_back();
+	}
+};
+
+// Moves the cell at the end of `decomposition` to index `to` and updates the
+// links and the grid entry pointing to it.
+template<int D>
+void moveLastCell(Decomposition<D>& decomposition, CellGrid<D>& grid, RepairLog& log, int to) {
+	log.moveLast(to);
+	int from = decomposition.size() - 1;
+	if (from != to) {
+		grid.remove(from, decomposition[from].box);
+		grid.add(to, decomposition[from].box);
+		decomposition[to] = std::move(decomposition[from]);
+		for(int dir=0; dir<2*D; ++dir) {
+			for(int j: decomposition[to].links[dir]) {
+				vector<int>& links = decomposition[j].links[dir^1];
+				replace(links.begin(), links.end(), from, to);
+				sort(links.begin(), links.end());
+			}
+		}
+	}
+	decomposition.pop_back();
+}
+
+// Rounds `x / d` down for a positive `d`.
+int floorDiv(int x, int d) {
+	return x >= 0 ? x / d : -((-x + d - 1) / d);
+}
+
+} // namespace
+
+template<int D>
+CellGrid<D>::CellGrid(const Decomposition<D>& decomposition) {
+	if (decomposition.empty()) return;
+	Box<D> bounds = decomposition[0].box;
+	for(const Cell<D>& cell: decomposition) extendBox(bounds, cell.box);
+	double volume = 1;
+	for(int i=0; i<D; ++i) volume *= bounds[i].size();
+	bucketSize = max(1, (int)pow(volume / decomposition.size(), 1.0 / D));
+	for(size_t i=0; i<decomposition.size(); ++i) add(i, decomposition[i].box);
+}
+
+template<int D>
+size_t CellGrid<D>::KeyHash::operator()(const Point<D>& p) const {
+	// Products of far bucket coordinates would overflow in int.
+	size_t res = 101;
+	for(int i=0; i<D; ++i) res = 33331*res + 65537*(size_t)p[i];
+	return res;
+}
+
+template<int D>
+template<class F>
+void CellGrid<D>::forBuckets(const Box<D>& box, F&& f) const {
+	Point<D> from, to;
+	for(int i=0; i<D; ++i) {
+		from[i] = floorDiv(box[i].from, bucketSize);
+		to[i] = floorDiv(box[i].to - 1, bucketSize);
+	}
+	Point<D> p = from;
+	while(true) {
+		f(p);
+		int i = 0;
+		for(; i<D && p[i] == to[i]; ++i) p[i] = from[i];
+		if (i == D) break;
+		++p[i];
+	}
+}
+
+template<int D>
+vector<int> CellGrid<D>::cellsIntersecting(const Decomposition<D>& decomposition, const Box<D>& box) const {
+	vector<int> res;
+	forBuckets(box, [&](const Point<D>& p) {
+		auto it = buckets.find(p);
+		if (it == buckets.end()) return;
+		entriesRead += it->second.size();
+		for(int cell: it->second) {
+			if (decomposition[cell].box.intersects(box)) res.push_back(cell);
+		}
+	});
+	sortUnique(res);
+	return res;
+}
+
+template<int D>
+int CellGrid<D>::cellContaining(const Decomposition<D>& decomposition, const Point<D>& p) const {
+	Point<D> bucket;
+	for(int i=0; i<D; ++i) bucket[i] = floorDiv(p[i], bucketSize);
+	auto it = buckets.find(bucket);
+	if (it == buckets.end()) return -1;
+	for(int cell: it->second) {
+		if (decomposition[cell].box.contains(p)) return cell;
+	}
+	return -1;
+}
+
+template<int D>
+void CellGrid<D>::add(int cell, const Box<D>& box) {
+	forBuckets(box, [&](const Point<D>& p) {
+		buckets[p].push_back(cell);
+	});
+}
+
+template<int D>
+void CellGrid<D>::remove(int cell, const Box<D>& box) {
+	forBuckets(box, [&](const Point<D>& p) {
+		auto it = buckets.find(p);
+		vector<int>& cells = it->second;
+		*find(cells.begin(), cells.end(), cell) = cells.back();
+		cells.pop_back();
+		if (cells.empty()) buckets.erase(it);
+	});
+}
+
+namespace {
+
+// Decomposes again the free space of the cells intersecting `region` after
+// the obstacles at indices `added` have been added to `obstacles`. The
+// obstacles at indices `skip` are left out of the region, as they have been
+// added or removed.
+//
+// Its free space is decomposed again with `decomposeFreeSpace` after closing
+// it with temporary obstacles where it continues to the cells outside the
+// region. The links and obstacles of the new cells are then computed with
+// `computeLinksInDir` against the neighbor cells outside the region. The
+// obstacles bounding the free space inside the region either bound one of its
+// old cells or are added, so neither the other cells nor the other obstacles
+// are visited.
+template<int D>
+void repairRegion(const ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		RepairLog& log, const Box<D>& region, const vector<int>& added, const vector<int>& skip) {
+	vector<int> oldCells = grid.cellsIntersecting(decomposition, region);
+	vector<int> outside;
+	ObstacleSet<D> localObstacles = regionWalls(decomposition, oldCells, outside);
+	const int wallCount = localObstacles.size();
+	// Index in `obstacles` of each non-wall obstacle of `localObstacles`.
+	vector<int> localIndex;
+	boundingObstacles(obstacles, decomposition, oldCells, skip, localObstacles, localIndex);
+	for(int i: added) {
+		localObstacles.push_back(obstacles[i]);
+		localIndex.push_back(i);
+	}
+	Decomposition<D> local = decomposeFreeSpace(localObstacles);
+
+	for(int i: outside) {
+		for(vector<int>& links: decomposition[i].links) {
+			links.erase(remove_if(links.begin(), links.end(), [&](int j) {
+				return binary_search(oldCells.begin(), oldCells.end(), j);
+			}), links.end());
+		}
+	}
+	for(int i: oldCells) grid.remove(i, decomposition[i].box);
+	// Index in `decomposition` of each cell of `local`.
+	vector<int> cellIndex(local.size());
+	for(size_t i=0; i<local.size(); ++i) {
+		if (i < oldCells.size()) {
+			cellIndex[i] = oldCells[i];
+			decomposition[oldCells[i]] = Cell<D>(local[i].box);
+		} else {
+			cellIndex[i] = decomposition.size();
+			decomposition.emplace_back(local[i].box);
+		}
+		log.newCell(cellIndex[i]);
+		grid.add(cellIndex[i], local[i].box);
+	}
+
+	// The new cells followed by the outside neighbors, without links.
+	Decomposition<D> linkCells;
+	for(const Cell<D>& cell: local) linkCells.emplace_back(cell.box);
+	for(int i: outside) linkCells.emplace_back(decomposition[i].box);
+	ObstacleSpan<D> linkObstacles(localObstacles.data() + wallCount, localObstacles.data() + localObstacles.size());
+	for(int axis=0; axis<D; ++axis) computeLinksInDir(linkCells, linkObstacles, axis);
+	auto globalIndex = [&](int j) {
+		return j < (int)local.size() ? cellIndex[j] : outside[j - local.size()];
+	};
+	for(size_t i=0; i<local.size(); ++i) {
+		Cell<D>& cell = decomposition[cellIndex[i]];
+		for(int dir=0; dir<2*D; ++dir) {
+			for(int j: linkCells[i].links[dir]) {
+				cell.links[dir].push_back(globalIndex(j));
+				if (j >= (int)local.size()) {
+					decomposition[globalIndex(j)].links[dir^1].push_back(cellIndex[i]);
+				}
+			}
+			for(int j: linkCells[i].obstacles[dir]) {
+				cell.obstacles[dir].push_back(localIndex[j]);
+			}
+			sortUnique(cell.links[dir]);
+			sortUnique(cell.obstacles[dir]);
+		}
+	}
+	for(int i: outside) {
+		for(vector<int>& links: decomposition[i].links) sortUnique(links);
+	}
+
+	for(size_t i=oldCells.size(); i-- > local.size(); ) {
+		moveLastCell(decomposition, grid, log, oldCells[i]);
+	}
+}
+
+// Group of changed obstacles repaired together.
+template<int D>
+struct ChangeCluster {
+	// Bounds of the changed obstacles with a margin of one unit.
+	Box<D> region;
+	// Cells intersecting `region`.
+	vector<int> cells;
+	// Indices of the added obstacles in the cluster.
+	vector<int> added;
+};
+
+// Returns true if the sorted `a` and `b` have a common element.
+bool haveCommon(const vector<int>& a, const vector<int>& b) {
+	for(size_t i=0, j=0; i<a.size() && j<b.size(); ) {
+		if (a[i] == b[j]) return true;
+		if (a[i] < b[j]) ++i; else ++j;
+	}
+	return false;
+}
+
+// The changes are grouped into clusters whose regions neither intersect nor
+// share cells, and each cluster is repaired on its own, so distant changes
+// do not repair the cells between them. The region of a cluster is the box
+// around its changed obstacles with a margin of one unit, together with the
+// cells intersecting it. The free space outside the regions is unchanged
+// because of the margin. The changes of one cluster do not reach the cells
+// of another, so repairing the clusters one after another gives the same
+// free space as repairing them all at once.
+template<int D>
+vector<int> updateCells(ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		const vector<int>& removed, const ObstacleSet<D>& added, RepairLog& log) {
+	vector<ChangeCluster<D>> clusters;
+	auto addCluster = [&](const Box<D>& box) {
+		ChangeCluster<D> c;
+		c.region = box;
+		for(int i=0; i<D; ++i) c.region[i] = {box[i].from-1, box[i].to+1};
+		clusters.push_back(c);
+	};
+	// The placeholders of obstacles removed earlier change nothing.
+	for(int i: removed) {
+		if (obstacles[i].direction >= 0) addCluster(obstacles[i].box);
+	}
+	vector<int> freeSlots;
+	for(int i: removed) {
+		obstacles[i] = Obstacle<D>();
+		obstacles[i].direction = -1;
+		freeSlots.push_back(i);
+	}
+	vector<int> addedIndex;
+	for(const Obstacle<D>& obs: added) {
+		if (freeSlots.empty()) {
+			addedIndex.push_back(obstacles.size());
+			obstacles.push_back(obs);
+		} else {
+			addedIndex.push_back(freeSlots.back());
+			obstacles[freeSlots.back()] = obs;
+			freeSlots.pop_back();
+		}
+		addCluster(obs.box);
+		clusters.back().added.push_back(addedIndex.back());
+	}
+
+	// Merges the clusters until no two of them meet. Each merge grows the
+	// region to the bounds of both, which may make it meet other clusters.
+	// The regions are merged first, as the cells are only looked up for the
+	// clusters left after that.
+	auto mergeClusters = [&](bool byCells) {
+		for(size_t i=0; i<clusters.size(); ) {
+			size_t j = i+1;
+			while(j < clusters.size() && !clusters[i].region.intersects(clusters[j].region)
+					&& !(byCells && haveCommon(clusters[i].cells, clusters[j].cells))) {
+				++j;
+			}
+			if (j == clusters.size()) {
+				++i;
+				continue;
+			}
+			ChangeCluster<D>& c = clusters[i];
+			extendBox(c.region, clusters[j].region);
+			if (byCells) c.cells = grid.cellsIntersecting(decomposition, c.region);
+			moveAppend(c.added, clusters[j].added);
+			clusters.erase(clusters.begin() + j);
+			i = 0;
+		}
+	};
+	mergeClusters(false);
+	if (clusters.size() > 1) {
+		for(ChangeCluster<D>& c: clusters) c.cells = grid.cellsIntersecting(decomposition, c.region);
+		mergeClusters(true);
+	}
+
+	vector<int> skip = addedIndex;
+	sortUnique(skip);
+	for(const ChangeCluster<D>& c: clusters) {
+		repairRegion(obstacles, decomposition, grid, log, c.region, c.added, skip);
+	}
+	return addedIndex;
+}
+
+} // namespace
+
+template<int D>
+vector<int> updateDecomposition(ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		const vector<int>& removed, const ObstacleSet<D>& added) {
+	RepairLog log;
+	return updateCells(obstacles, decomposition, grid, removed, added, log);
+}
+
+template<int D>
+vector<int> updateDecomposition(ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		const vector<int>& removed, const ObstacleSet<D>& added, vector<int>& labels, vector<int>& repaired) {
+	repaired.clear();
+	RepairLog log;
+	log.labels = &labels;
+	log.repaired = &repaired;
+	vector<int> addedIndex = updateCells(obstacles, decomposition, grid, removed, added, log);
+	sortUnique(repaired);
+	return addedIndex;
+}
+
+template
+bool tryDecomposeFreeSpace<3>(ObstacleSpan<3> obstacles, const CancelToken& cancel, Decomposition<3>& result);
+template
+Decomposition<2> decomposeFreeSpace<2>(ObstacleSpan<2> obstacles);
+template
+Decomposition<3> decomposeFreeSpace<3>(ObstacleSpan<3> obstacles);
+template
+vector<int> connectedComponents<2>(const Decomposition<2>& decomposition);
+template
+vector<int> connectedComponents<3>(const Decomposition<3>& decomposition);
+template
+void updateComponents<2>(const Decomposition<2>& decomposition, const vector<int>& repaired,
+		vector<int>& components, int& labelCount);
+template
+void updateComponents<3>(const Decomposition<3>& decomposition, const vector<int>& repaired,
+		vector<int>& components, int& labelCount);
+template class CellGrid<2>;
+template class CellGrid<3>;
+template
+vector<int> updateDecomposition<2>(ObstacleSet<2>& obstacles, Decomposition<2>& decomposition, CellGrid<2>& grid,
+		const vector<int>& removed, const ObstacleSet<2>& added);
+template
+vector<int> updateDecomposition<3>(ObstacleSet<3>& obstacles, Decomposition<3>& decomposition, CellGrid<3>& grid,
+		const vector<int>& removed, const ObstacleSet<3>& added);
+template
+vector<int> updateDecomposition<2>(ObstacleSet<2>& obstacles, Decomposition<2>& decomposition, CellGrid<2>& grid,
+		const vector<int>& removed, const ObstacleSet<2>& added, vector<int>& labels, vector<int>& repaired);
 template
-Decomposition<3> decomposeFreeSpace<3>(const ObstacleSet<3>& obstacles);
+vector<int> updateDecomposition<3>(ObstacleSet<3>& obstacles, Decomposition<3>& decomposition, CellGrid<3>& grid,
+		const vector<int>& removed, const ObstacleSet<3>& added, vector<int>& labels, vector<int>& repaired);
@@ -1,6 +1,9 @@
 #pragma once
 #include "Box.hpp"
+#include "CancelToken.hpp"
 #include "print.hpp"
+#include "Span.hpp"
+#include <unordered_map>
 #include <vector>
 
 // Cell of `D`-dimensional free space decomposition.
@@ -29,6 +32,8 @@ using Decomposition = std::vector<Cell<D>>;
 template<int D>
 struct Obstacle {
 	Box<D> box;
+	// Negative for a placeholder of an obstacle removed by
+	// `updateDecomposition`. The placeholders are ignored by the decomposition.
 	int direction = 0;
 };
 template<int D>
@@ -39,7 +44,108 @@ std::ostream& operator<<(std::ostream& o, const Obstacle<D>& x) {
 template<int D>
 using ObstacleSet = std::vector<Obstacle<D>>;
 
+// Obstacles borrowed from the caller, for example a range of an
+// `ObstacleSet` or of an array filled by a foreign caller.
+template<int D>
+using ObstacleSpan = Span<const Obstacle<D>>;
+
 // Returns decomposition of the free space (space not contained by any
-// obstacles) into rectangular cells. Complexity O(n^(D-1)*log n).
+// obstacles) into rectangular cells. Complexity O(n^(D-1)*log n). The cells
+// refer to the obstacles by their index in `obstacles`, which are not copied.
+template<int D>
+Decomposition<D> decomposeFreeSpace(ObstacleSpan<D> obstacles);
+
+template<int D>
+Decomposition<D> decomposeFreeSpace(const ObstacleSet<D>& obstacles) {
+	return decomposeFreeSpace(ObstacleSpan<D>(obstacles));
+}
+
+// Same as `decomposeFreeSpace`, but checks `cancel` at each depth of the sweep.
+// Returns false if the computation was cancelled, in which case `result` is
+// left unchanged.
+template<int D>
+bool tryDecomposeFreeSpace(ObstacleSpan<D> obstacles, const CancelToken& cancel, Decomposition<D>& result);
+
+template<int D>
+bool tryDecomposeFreeSpace(const ObstacleSet<D>& obstacles, const CancelToken& cancel, Decomposition<D>& result) {
+	return tryDecomposeFreeSpace(ObstacleSpan<D>(obstacles), cancel, result);
+}
+
+// Labels the cells of `decomposition` by the connected components of their
+// links. Returns the component of each cell, numbered from 0 in the order of
+// the first cell of each component.
+template<int D>
+std::vector<int> connectedComponents(const Decomposition<D>& decomposition);
+
+// Updates `components`, labels of the connected components of the cells of
+// `decomposition` such as those returned by `connectedComponents`, after
+// `updateDecomposition` has decomposed the sorted cells `repaired` again and
+// labelled them -1. Only the components near the repaired cells are
+// searched, and joined or split components are relabelled without walking
+// the largest part of them. New labels are taken from `labelCount` on, which
+// is increased past them, so labels no longer in use are not reused.
+template<int D>
+void updateComponents(const Decomposition<D>& decomposition, const std::vector<int>& repaired,
+		std::vector<int>& components, int& labelCount);
+
+// Sparse uniform grid of buckets listing the cells of a decomposition that
+// overlap them, for finding the cells near a box without scanning the whole
+// decomposition. The bucket size is chosen so that there are about as many
+// buckets as cells.
+template<int D>
+class CellGrid {
+public:
+	CellGrid() {}
+	explicit CellGrid(const Decomposition<D>& decomposition);
+
+	// Returns the sorted indices of the cells of `decomposition` intersecting
+	// the nonempty `box`.
+	std::vector<int> cellsIntersecting(const Decomposition<D>& decomposition, const Box<D>& box) const;
+	// Returns the index of the cell of `decomposition` containing `p`, or -1
+	// if `p` is not in the free space. Reads a single bucket, and may be
+	// called concurrently.
+	int cellContaining(const Decomposition<D>& decomposition, const Point<D>& p) const;
+	void add(int cell, const Box<D>& box);
+	void remove(int cell, const Box<D>& box);
+
+	// Number of bucket entries read by `cellsIntersecting`, which bounds its
+	// work.
+	mutable long entriesRead = 0;
+
+private:
+	struct KeyHash {
+		size_t operator()(const Point<D>& p) const;
+	};
+
+	// Calls `f(bucket)` for the buckets overlapping `box`.
+	template<class F>
+	void forBuckets(const Box<D>& box, F&& f) const;
+
+	int bucketSize = 1;
+	std::unordered_map<Point<D>, std::vector<int>, KeyHash> buckets;
+};
+
+// Removes the obstacles at indices `removed` from `obstacles`, adds `added`
+// and repairs `decomposition` and its `grid` to match. Only the cells in
+// regions around the groups of nearby changed obstacles are decomposed again,
+// and the other cells keep their indices except for filling the gaps left by
+// removed cells. The cells and obstacles of the regions are found through
+// `grid` and the obstacles of the cells, so the work does not grow with the
+// size of the decomposition or the distance between the changes. The removed obstacles are left as placeholders so that the
+// indices of the other obstacles do not change, and the placeholders are
+// reused by the added obstacles. Returns the indices of the added obstacles.
+//
+// After the update, the obstacles must bound the free space like the
+// obstacles given to `decomposeFreeSpace`.
+template<int D>
+std::vector<int> updateDecomposition(ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		const std::vector<int>& removed, const ObstacleSet<D>& added);
+
+// Same as above, and keeps `labels`, a value for each cell of
+// `decomposition`, with their cells as the cells are moved. The cells
+// decomposed again are labelled -1 and their sorted indices are stored in
+// `repaired`.
 template<int D>
-Decomposition<D> decomposeFreeSpace(const ObstacleSet<D>& obstacles);
+std::vector<int> updateDecomposition(ObstacleSet<D>& obstacles, Decomposition<D>& decomposition, CellGrid<D>& grid,
+		const std::vector<int>& removed, const ObstacleSet<D>& added,
+		std::vector<int>& labels, std::vector<int>& repaired);
@@ -1,6 +1,11 @@
 #include "decomposition.hpp"
 #include "obstacles.hpp"
+#include "boxUnion.hpp"
+#include <algorithm>
 #include <cstring>
+#include <map>
+#include <random>
+#include <set>
 #include <gmock/gmock-more-matchers.h>
 #include <gtest/gtest.h>
 
@@ -61,6 +66,15 @@ vector<int> getLinksInDir(const Decomposition<D>& dec, size_t index, int dir) {
 	}
 	return res;
 }
+template<int D>
+vector<int> getCellsIntersecting(const Decomposition<D>& dec, const Box<D>& box) {
+	vector<int> res;
+	for(size_t i=0; i<dec.size(); ++i) {
+		if (box.intersects(dec[i].box)) res.push_back(i);
+	}
+	return res;
+}
+
 template<int D>
 vector<int> getObstaclesInDir(const ObstacleSet<D>& obs, const Box<D>& box, int dir) {
 	Box<D> target = makeBoundaryBox(box, dir);
@@ -94,6 +108,61 @@ void checkObstacles(const Decomposition<D>& dec, const ObstacleSet<D>& obstacles
 }
 
 
+// Returns the indices of the obstacles of `a` that are not in `b`, leaving out
+// the placeholders of removed obstacles.
+template<int D>
+vector<int> obstacleDifference(const ObstacleSet<D>& a, const ObstacleSet<D>& b) {
+	set<pair<Box<D>, int>> inB;
+	for(const Obstacle<D>& o: b) inB.emplace(o.box, o.direction);
+	vector<int> res;
+	for(size_t i=0; i<a.size(); ++i) {
+		if (a[i].direction >= 0 && !inB.count({a[i].box, a[i].direction})) res.push_back(i);
+	}
+	return res;
+}
+
+// Updates `obstacles` and `dec` to the obstacles `target` and checks the
+// result against a full rebuild.
+template<int D>
+void checkUpdate(ObstacleSet<D>& obstacles, Decomposition<D>& dec, CellGrid<D>& grid, const ObstacleSet<D>& target) {
+	vector<int> removed = obstacleDifference(obstacles, target);
+	ObstacleSet<D> added;
+	for(int i: obstacleDifference(target, obstacles)) added.push_back(target[i]);
+	vector<int> addedIndex = updateDecomposition(obstacles, dec, grid, removed, added);
+	ASSERT_EQ(addedIndex.size(), added.size());
+	for(size_t i=0; i<added.size(); ++i) {
+		EXPECT_EQ(obstacles[addedIndex[i]].box, added[i].box);
+	}
+	Decomposition<D> rebuilt = decomposeFreeSpace(target);
+	vector<Box<D>> expected = boxUnion(getBoxes(rebuilt)), actual = boxUnion(getBoxes(dec));
+	sort(expected.begin(), expected.end());
+	sort(actual.begin(), actual.end());
+	EXPECT_EQ(actual, expected);
+	for(size_t i=0; i<dec.size(); ++i) {
+		for(size_t j=0; j<i; ++j) {
+			EXPECT_FALSE(dec[i].box.intersects(dec[j].box)) << dec[i].box << ' ' << dec[j].box;
+		}
+	}
+	checkLinks(dec);
+	checkObstacles(dec, obstacles);
+	for(size_t i=0; i<dec.size(); ++i) {
+		Box<D> b = dec[i].box;
+		for(int j=0; j<D; ++j) b[j] = {b[j].from-1, b[j].to+1};
+		EXPECT_EQ(grid.cellsIntersecting(dec, b), getCellsIntersecting(dec, b)) << b;
+		Point<D> low, high;
+		for(int j=0; j<D; ++j) {
+			low[j] = dec[i].box[j].from;
+			high[j] = dec[i].box[j].to - 1;
+		}
+		EXPECT_EQ(grid.cellContaining(dec, low), (int)i) << low;
+		EXPECT_EQ(grid.cellContaining(dec, high), (int)i) << high;
+	}
+	Point<D> outside;
+	for(int j=0; j<D; ++j) outside[j] = -1000;
+	EXPECT_EQ(grid.cellContaining(dec, outside), -1);
+}
+
+
 TEST(DecompositionTest2D, DecomposeEmpty) {
 	ObstacleSet<2> obs;
 	EXPECT_THAT(decomposeFreeSpace(obs), IsEmpty());
@@ -165,6 +234,237 @@ TEST(DecompositionTest2D, ManyChangesOnSingleLevel) {
 }
 
 
+TEST(DecompositionTest2D, ConnectedComponents) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"..#.", "###.", ".#.."});
+	Decomposition<2> dec = decomposeFreeSpace(obs);
+	vector<int> components = connectedComponents(dec);
+	ASSERT_EQ(components.size(), dec.size());
+	auto componentOf = [&](Point<2> p) {
+		for(size_t i=0; i<dec.size(); ++i) {
+			if (dec[i].box.contains(p)) return components[i];
+		}
+		return -1;
+	};
+	EXPECT_EQ(componentOf({1,1}), componentOf({2,1}));
+	EXPECT_EQ(componentOf({4,1}), componentOf({3,3}));
+	EXPECT_EQ(componentOf({4,2}), componentOf({4,3}));
+	EXPECT_NE(componentOf({1,1}), componentOf({4,1}));
+	EXPECT_NE(componentOf({1,3}), componentOf({1,1}));
+	EXPECT_NE(componentOf({1,3}), componentOf({4,1}));
+	EXPECT_EQ(*max_element(components.begin(), components.end()), 2);
+}
+
+TEST(DecompositionTest2D, TryDecomposeCancelled) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"#..", "..."});
+	CancelToken cancel;
+	Decomposition<2> result;
+	ASSERT_TRUE(tryDecomposeFreeSpace(obs, cancel, result));
+	EXPECT_EQ(getBoxes(result), getBoxes(decomposeFreeSpace(obs)));
+	cancel.cancel();
+	Decomposition<2> cancelled;
+	EXPECT_FALSE(tryDecomposeFreeSpace(obs, cancel, cancelled));
+	EXPECT_THAT(cancelled, IsEmpty());
+}
+
+TEST(DecompositionTest2D, UpdateAddAndRemoveBlock) {
+	vector<string> grid = {".....", ".....", "....."};
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	Decomposition<2> dec = decomposeFreeSpace(obstacles);
+	CellGrid<2> cellGrid(dec);
+	grid[1][2] = '#';
+	checkUpdate(obstacles, dec, cellGrid, makeObstaclesForPlane(grid));
+	grid[1][2] = '.';
+	checkUpdate(obstacles, dec, cellGrid, makeObstaclesForPlane(grid));
+	EXPECT_EQ(dec.size(), 1u);
+}
+
+TEST(DecompositionTest2D, UpdateRandom) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		vector<string> grid(10, string(10, '.'));
+		for(string& row: grid) {
+			for(char& c: row) c = rng()%4 ? '.' : '#';
+		}
+		ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+		Decomposition<2> dec = decomposeFreeSpace(obstacles);
+		CellGrid<2> cellGrid(dec);
+		for(int j=0; j<10; ++j) {
+			int x = rng()%9, y = rng()%9;
+			char c = rng()%2 ? '.' : '#';
+			for(int dy=0; dy<(int)(1+rng()%2); ++dy) {
+				for(int dx=0; dx<(int)(1+rng()%2); ++dx) grid[y+dy][x+dx] = c;
+			}
+			checkUpdate(obstacles, dec, cellGrid, makeObstaclesForPlane(grid));
+		}
+	}
+}
+
+TEST(DecompositionTest2D, UpdateRandomScattered) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		vector<string> grid(24, string(24, '.'));
+		for(string& row: grid) {
+			for(char& c: row) c = rng()%4 ? '.' : '#';
+		}
+		ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+		Decomposition<2> dec = decomposeFreeSpace(obstacles);
+		CellGrid<2> cellGrid(dec);
+		for(int j=0; j<5; ++j) {
+			// Several changes per update, mostly far enough apart to be
+			// repaired separately.
+			for(int k=0; k<4; ++k) {
+				int x = rng()%24, y = rng()%24;
+				grid[y][x] = grid[y][x] == '.' ? '#' : '.';
+			}
+			checkUpdate(obstacles, dec, cellGrid, makeObstaclesForPlane(grid));
+		}
+	}
+}
+
+// Checks that `labels` partition the cells of `dec` like `connectedComponents`.
+template<int D>
+void checkComponents(const Decomposition<D>& dec, const vector<int>& labels, int labelCount) {
+	vector<int> expected = connectedComponents(dec);
+	ASSERT_EQ(labels.size(), expected.size());
+	map<int, int> toExpected, fromExpected;
+	for(size_t i=0; i<labels.size(); ++i) {
+		ASSERT_GE(labels[i], 0);
+		ASSERT_LT(labels[i], labelCount);
+		EXPECT_EQ(toExpected.emplace(labels[i], expected[i]).first->second, expected[i]) << dec[i].box;
+		EXPECT_EQ(fromExpected.emplace(expected[i], labels[i]).first->second, labels[i]) << dec[i].box;
+	}
+}
+
+TEST(DecompositionTest2D, UpdateComponents) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		// Dense enough to have many components that the updates join and
+		// split.
+		vector<string> grid(16, string(16, '.'));
+		for(string& row: grid) {
+			for(char& c: row) c = rng()%5 < 2 ? '#' : '.';
+		}
+		ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+		Decomposition<2> dec = decomposeFreeSpace(obstacles);
+		CellGrid<2> cellGrid(dec);
+		vector<int> labels = connectedComponents(dec);
+		int labelCount = *max_element(labels.begin(), labels.end()) + 1;
+		for(int j=0; j<20; ++j) {
+			for(int k=0; k<(int)(1+rng()%3); ++k) {
+				int x = rng()%16, y = rng()%16;
+				grid[y][x] = grid[y][x] == '.' ? '#' : '.';
+			}
+			ObstacleSet<2> target = makeObstaclesForPlane(grid);
+			vector<int> removed = obstacleDifference(obstacles, target);
+			ObstacleSet<2> added;
+			for(int k: obstacleDifference(target, obstacles)) added.push_back(target[k]);
+			vector<int> repaired;
+			updateDecomposition(obstacles, dec, cellGrid, removed, added, labels, repaired);
+			for(int cell: repaired) EXPECT_EQ(labels[cell], -1);
+			updateComponents(dec, repaired, labels, labelCount);
+			checkComponents(dec, labels, labelCount);
+		}
+	}
+}
+
+TEST(DecompositionTest2D, UpdateComponentsRelabelsSmallerPart) {
+	// A room in the corner of an open map, with a door at (3, 1).
+	vector<string> grid(40, string(40, '.'));
+	for(int i=0; i<4; ++i) grid[4][i] = grid[i][4] = '#';
+	grid[1][4] = '.';
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	Decomposition<2> dec = decomposeFreeSpace(obstacles);
+	CellGrid<2> cellGrid(dec);
+	vector<int> labels = connectedComponents(dec);
+	int labelCount = 1;
+	for(int close=1; close>=0; --close) {
+		grid[1][4] = close ? '#' : '.';
+		ObstacleSet<2> target = makeObstaclesForPlane(grid);
+		vector<int> removed = obstacleDifference(obstacles, target);
+		ObstacleSet<2> added;
+		for(int k: obstacleDifference(target, obstacles)) added.push_back(target[k]);
+		vector<int> repaired;
+		updateDecomposition(obstacles, dec, cellGrid, removed, added, labels, repaired);
+		updateComponents(dec, repaired, labels, labelCount);
+		checkComponents(dec, labels, labelCount);
+		// The open part keeps its label.
+		int cell = cellGrid.cellContaining(dec, {30, 30});
+		ASSERT_GE(cell, 0);
+		EXPECT_EQ(labels[cell], 0);
+	}
+}
+
+TEST(DecompositionTest2D, UpdateIsLocal) {
+	mt19937 rng(1);
+	vector<string> grid(200, string(200, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	Decomposition<2> dec = decomposeFreeSpace(obstacles);
+	CellGrid<2> cellGrid(dec);
+	ASSERT_GT(dec.size(), 5000u);
+	for(int i=0; i<10; ++i) {
+		int x = 1 + rng()%198, y = 1 + rng()%198;
+		grid[y][x] = grid[y][x] == '.' ? '#' : '.';
+		ObstacleSet<2> target = makeObstaclesForPlane(grid);
+		vector<int> removed = obstacleDifference(obstacles, target);
+		ObstacleSet<2> added;
+		for(int j: obstacleDifference(target, obstacles)) added.push_back(target[j]);
+		cellGrid.entriesRead = 0;
+		updateDecomposition(obstacles, dec, cellGrid, removed, added);
+		// The cells around the changed unit square, out of thousands.
+		EXPECT_LT(cellGrid.entriesRead, 50) << x << ' ' << y;
+
+		vector<Box<2>> expected = boxUnion(getBoxes(decomposeFreeSpace(target)));
+		vector<Box<2>> actual = boxUnion(getBoxes(dec));
+		sort(expected.begin(), expected.end());
+		sort(actual.begin(), actual.end());
+		EXPECT_EQ(actual, expected);
+	}
+}
+
+TEST(DecompositionTest2D, UpdateDistantChangesSeparately) {
+	mt19937 rng(2);
+	vector<string> grid(200, string(200, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	Decomposition<2> dec = decomposeFreeSpace(obstacles);
+	CellGrid<2> cellGrid(dec);
+	for(int i=0; i<10; ++i) {
+		// Opposite corners of the map in a single update.
+		int x = 1 + rng()%20, y = 1 + rng()%20;
+		grid[y][x] = grid[y][x] == '.' ? '#' : '.';
+		grid[198-y][198-x] = grid[198-y][198-x] == '.' ? '#' : '.';
+		ObstacleSet<2> target = makeObstaclesForPlane(grid);
+		vector<int> removed = obstacleDifference(obstacles, target);
+		ObstacleSet<2> added;
+		for(int j: obstacleDifference(target, obstacles)) added.push_back(target[j]);
+		cellGrid.entriesRead = 0;
+		updateDecomposition(obstacles, dec, cellGrid, removed, added);
+		// The cells around the two squares, looked up once to group the
+		// changes and once to repair them, instead of the cells between.
+		EXPECT_LT(cellGrid.entriesRead, 200) << x << ' ' << y;
+
+		vector<Box<2>> expected = boxUnion(getBoxes(decomposeFreeSpace(target)));
+		vector<Box<2>> actual = boxUnion(getBoxes(dec));
+		sort(expected.begin(), expected.end());
+		sort(actual.begin(), actual.end());
+		EXPECT_EQ(actual, expected);
+	}
+}
+
+TEST(DecompositionTest3D, TryDecomposeCancelled) {
+	ObstacleSet<3> obs = makeObstaclesForVolume({{"#.", ".."}, {"..", ".."}});
+	CancelToken cancel;
+	cancel.cancel();
+	Decomposition<3> result;
+	EXPECT_FALSE(tryDecomposeFreeSpace(obs, cancel, result));
+	EXPECT_THAT(result, IsEmpty());
+}
+
 TEST(DecompositionTest3D, DecomposeEmpty) {
 	ObstacleSet<3> obs;
 	EXPECT_THAT(decomposeFreeSpace(obs), IsEmpty());
@@ -221,4 +521,55 @@ TEST(DecompositionTest3D, DecomposeDeepCells) {
 	checkObstacles(result, obs);
 }
 
+TEST(DecompositionTest3D, DecomposeSpan) {
+	mt19937 rng(0);
+	vector<vector<string>> volume(5, vector<string>(5, string(5, '.')));
+	for(auto& plane: volume) {
+		for(string& row: plane) {
+			for(char& c: row) c = rng()%4 ? '.' : '#';
+		}
+	}
+	ObstacleSet<3> obstacles = makeObstaclesForVolume(volume);
+	// The span borrows the obstacles from the middle of a larger array.
+	ObstacleSet<3> buffer(3);
+	buffer.insert(buffer.end(), obstacles.begin(), obstacles.end());
+	buffer.resize(buffer.size() + 3);
+	ObstacleSpan<3> span(buffer.data() + 3, buffer.data() + 3 + obstacles.size());
+	Decomposition<3> expected = decomposeFreeSpace(obstacles);
+	Decomposition<3> result = decomposeFreeSpace(span);
+	EXPECT_EQ(getBoxes(result), getBoxes(expected));
+	for(size_t i=0; i<result.size() && i<expected.size(); ++i) {
+		for(int d=0; d<6; ++d) {
+			EXPECT_EQ(result[i].links[d], expected[i].links[d]);
+			EXPECT_EQ(result[i].obstacles[d], expected[i].obstacles[d]);
+		}
+	}
+	checkObstacles(result, obstacles);
+}
+
+TEST(DecompositionTest3D, UpdateRandom) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		vector<vector<string>> volume(5, vector<string>(5, string(5, '.')));
+		for(auto& plane: volume) {
+			for(string& row: plane) {
+				for(char& c: row) c = rng()%4 ? '.' : '#';
+			}
+		}
+		ObstacleSet<3> obstacles = makeObstaclesForVolume(volume);
+		Decomposition<3> dec = decomposeFreeSpace(obstacles);
+		CellGrid<3> cellGrid(dec);
+		for(int j=0; j<5; ++j) {
+			int x = rng()%4, y = rng()%4, z = rng()%4;
+			char c = rng()%2 ? '.' : '#';
+			for(int dz=0; dz<2; ++dz) {
+				for(int dy=0; dy<2; ++dy) {
+					for(int dx=0; dx<2; ++dx) volume[z+dz][y+dy][x+dx] = c;
+				}
+			}
+			checkUpdate(obstacles, dec, cellGrid, makeObstaclesForVolume(volume));
+		}
+	}
+}
+
 } // namespace
@@ -0,0 +1,107 @@
+// Answers a stream of link distance queries on a single map. See
+// `runQueryStream` for the input and output formats. Prints the throughput and
+// the latency percentiles to stderr at the end. With -p, writes the metrics of
+// the queries to METRICS_FILE in the Prometheus text format every 10 seconds
+// and at the end.
+//
+// Usage: linkBatch [-j THREADS] [-m MAX_LINKS] [-p METRICS_FILE] MAP [QUERIES]
+
+#include "mapFile.hpp"
+#include "metrics.hpp"
+#include "queryStream.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+int usage() {
+	cerr << "usage: linkBatch [-j THREADS] [-m MAX_LINKS] [-p METRICS_FILE] MAP [QUERIES]\n";
+	return 2;
+}
+
+template<int D>
+bool run(const LinkIndex<D>& index, istream& in, const QueryStreamOptions& options) {
+	QueryStreamStats stats;
+	string error;
+	bool ok = runQueryStream(index, in, cout, options, stats, error);
+	if (!ok) cerr << error << '\n';
+	const LatencyHistogram& h = stats.latency;
+	auto micros = [](uint64_t nanos) { return nanos / 1000.0; };
+	cerr << fixed << setprecision(1)
+		<< stats.queries << " queries in " << stats.seconds << " s, "
+		<< (stats.seconds > 0 ? stats.queries / stats.seconds : 0) << " queries/s\n"
+		<< "latency us: p50 " << micros(h.quantile(0.5))
+		<< " p90 " << micros(h.quantile(0.9))
+		<< " p99 " << micros(h.quantile(0.99))
+		<< " p99.9 " << micros(h.quantile(0.999))
+		<< " max " << micros(h.max()) << '\n';
+	return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	QueryStreamOptions options;
+	options.threads = thread::hardware_concurrency();
+	string metricsPath;
+	int arg = 1;
+	for(; arg+1 < argc && argv[arg][0] == '-' && argv[arg][1]; arg += 2) {
+		if (strcmp(argv[arg], "-j") == 0) {
+			options.threads = atoi(argv[arg+1]);
+		} else if (strcmp(argv[arg], "-m") == 0) {
+			options.maxLinks = atoi(argv[arg+1]);
+		} else if (strcmp(argv[arg], "-p") == 0) {
+			metricsPath = argv[arg+1];
+		} else {
+			return usage();
+		}
+	}
+	if (argc - arg < 1 || argc - arg > 2 || options.threads <= 0) return usage();
+	options.maxBlocks = 4 * options.threads;
+
+	ifstream mapIn(argv[arg]);
+	if (!mapIn) {
+		cerr << argv[arg] << ": cannot open\n";
+		return 1;
+	}
+	MapFile map;
+	string error;
+	if (!readMap(mapIn, map, error)) {
+		cerr << argv[arg] << ": " << error << '\n';
+		return 1;
+	}
+	ifstream queryFile;
+	if (argc - arg == 2 && strcmp(argv[arg+1], "-") != 0) {
+		queryFile.open(argv[arg+1]);
+		if (!queryFile) {
+			cerr << argv[arg+1] << ": cannot open\n";
+			return 1;
+		}
+	}
+	istream& in = queryFile.is_open() ? queryFile : cin;
+	ios::sync_with_stdio(false);
+	unique_ptr<MetricsExporter> exporter;
+	if (!metricsPath.empty()) exporter.reset(new MetricsExporter(metricsPath, chrono::seconds(10)));
+
+	auto start = chrono::steady_clock::now();
+	bool ok;
+	if (map.dims == 2) {
+		LinkIndex<2> index = buildLinkIndex(planeObstacles(map));
+		cerr << "index built in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+		ok = run(index, in, options);
+	} else {
+		LinkIndex<3> index = buildLinkIndex(volumeObstacles(map));
+		cerr << "index built in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+		ok = run(index, in, options);
+	}
+	return ok ? 0 : 1;
+}
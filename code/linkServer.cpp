@@ -0,0 +1,286 @@
+#include "linkServer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Reads exactly `size` bytes. Returns false on end of file, error or timeout.
+bool readAll(int fd, void* data, size_t size) {
+	char* p = static_cast<char*>(data);
+	while(size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+	const char* p = static_cast<const char*>(data);
+	while(size > 0) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+// Writes a response of `results`. The first two values of `out` are reserved
+// for the header.
+bool writeResponse(int fd, ServerStatus status, vector<int32_t>& out) {
+	static_assert(sizeof(ResponseHeader) == 2*sizeof(int32_t), "unexpected padding");
+	ResponseHeader header{status, (int32_t)out.size() - 2};
+	memcpy(out.data(), &header, sizeof(header));
+	return writeAll(fd, out.data(), out.size() * sizeof(int32_t));
+}
+
+template<int D>
+void runQueries(const LinkIndex<D>& index, QueryWorkspace<D>& workspace, const vector<int32_t>& points,
+		int maxLinks, vector<int32_t>& out) {
+	LinkDistanceOptions options;
+	options.maxLinks = maxLinks;
+	for(size_t i=0; i<points.size(); i+=2*D) {
+		Point<D> start, end;
+		for(int j=0; j<D; ++j) {
+			start[j] = points[i+j];
+			end[j] = points[i+D+j];
+		}
+		out.push_back(workspace.linkDistance(index, start, end, options));
+	}
+}
+
+} // namespace
+
+struct LinkServer::Worker {
+	vector<QueryWorkspace<2>> planes;
+	vector<QueryWorkspace<3>> volumes;
+	// Request payload and response buffers, reused between the requests.
+	vector<int32_t> in;
+	vector<int32_t> out;
+};
+
+int LinkServer::addMap(LinkIndex<2> index) {
+	maps.emplace_back(2, planes.size());
+	planes.push_back(move(index));
+	return maps.size() - 1;
+}
+
+int LinkServer::addMap(LinkIndex<3> index) {
+	maps.emplace_back(3, volumes.size());
+	volumes.push_back(move(index));
+	return maps.size() - 1;
+}
+
+bool LinkServer::serve(const string& path, int workers, string& error) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		error = "socket path too long: " + path;
+		return false;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		error = string("socket: ") + strerror(errno);
+		return false;
+	}
+	unlink(path.c_str());
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+		error = path + ": " + strerror(errno);
+		close(fd);
+		return false;
+	}
+	int pipeFds[2];
+	if (pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC) < 0) {
+		error = string("pipe: ") + strerror(errno);
+		close(fd);
+		return false;
+	}
+	{
+		lock_guard<std::mutex> lock(mutex);
+		wakeFd = pipeFds[1];
+	}
+
+	vector<thread> threads;
+	for(int i=0; i<max(workers, 1); ++i) {
+		threads.emplace_back([this]{ workerLoop(); });
+	}
+	pollLoop(fd, pipeFds[0]);
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(thread& t: threads) t.join();
+	{
+		lock_guard<std::mutex> lock(mutex);
+		wakeFd = -1;
+		for(auto& conn: idle) close(conn.first);
+		idle.clear();
+	}
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+	close(fd);
+	unlink(path.c_str());
+	return true;
+}
+
+void LinkServer::stop() {
+	lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+	wakePoller();
+	// The workers finish the requests they are reading and then see the
+	// end of the connection.
+	for(int conn: active) shutdown(conn, SHUT_RD);
+	wake.notify_all();
+}
+
+void LinkServer::wakePoller() {
+	int fd = wakeFd;
+	char c = 0;
+	// The pipe is nonblocking, and a full pipe wakes up the poller already.
+	if (fd >= 0 && write(fd, &c, 1) < 0) {}
+}
+
+void LinkServer::pollLoop(int listenSocket, int wakeSocket) {
+	timeval transfer;
+	transfer.tv_sec = timeouts.transfer.count() / 1000;
+	transfer.tv_usec = timeouts.transfer.count() % 1000 * 1000;
+	vector<pollfd> fds;
+	while(true) {
+		fds.assign({{listenSocket, POLLIN, 0}, {wakeSocket, POLLIN, 0}});
+		int timeout = -1;
+		{
+			lock_guard<std::mutex> lock(mutex);
+			if (stopping) return;
+			Clock::time_point now = Clock::now();
+			for(size_t i=0; i<idle.size(); ) {
+				Clock::time_point expiry = idle[i].second + timeouts.idle;
+				if (expiry <= now) {
+					close(idle[i].first);
+					idle[i] = idle.back();
+					idle.pop_back();
+					continue;
+				}
+				int left = chrono::duration_cast<chrono::milliseconds>(expiry - now).count() + 1;
+				if (timeout < 0 || left < timeout) timeout = left;
+				fds.push_back({idle[i].first, POLLIN, 0});
+				++i;
+			}
+		}
+		if (poll(fds.data(), fds.size(), timeout) < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		char buffer[64];
+		if (fds[1].revents) {
+			while(read(wakeSocket, buffer, sizeof(buffer)) > 0) {}
+		}
+		vector<int> accepted;
+		if (fds[0].revents) {
+			while(true) {
+				int conn = accept4(listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+				if (conn < 0) {
+					if (errno == EINTR || errno == ECONNABORTED) continue;
+					break;
+				}
+				setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &transfer, sizeof(transfer));
+				setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &transfer, sizeof(transfer));
+				accepted.push_back(conn);
+			}
+		}
+		bool ready = false;
+		{
+			lock_guard<std::mutex> lock(mutex);
+			Clock::time_point now = Clock::now();
+			// New connections wait for their first request like idle ones.
+			for(int conn: accepted) idle.emplace_back(conn, now);
+			for(size_t i=2; i<fds.size(); ++i) {
+				if (!fds[i].revents) continue;
+				for(size_t j=0; j<idle.size(); ++j) {
+					if (idle[j].first != fds[i].fd) continue;
+					pending.push_back(idle[j].first);
+					idle[j] = idle.back();
+					idle.pop_back();
+					ready = true;
+					break;
+				}
+			}
+		}
+		if (ready) wake.notify_all();
+	}
+}
+
+void LinkServer::workerLoop() {
+	Worker worker;
+	worker.planes.resize(planes.size());
+	worker.volumes.resize(volumes.size());
+	while(true) {
+		int fd;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]{ return stopping || !pending.empty(); });
+			if (stopping) {
+				for(int conn: pending) close(conn);
+				pending.clear();
+				return;
+			}
+			fd = pending.front();
+			pending.pop_front();
+			active.insert(fd);
+		}
+		bool keep = handleRequest(fd, worker);
+		lock_guard<std::mutex> lock(mutex);
+		active.erase(fd);
+		if (keep && !stopping) {
+			idle.emplace_back(fd, Clock::now());
+			wakePoller();
+		} else {
+			close(fd);
+		}
+	}
+}
+
+bool LinkServer::handleRequest(int fd, Worker& worker) {
+	RequestHeader header;
+	if (!readAll(fd, &header, sizeof(header))) return false;
+	worker.out.assign(2, 0);
+	if (header.map < 0 || header.map >= (int)maps.size()) {
+		writeResponse(fd, ServerStatus::BAD_REQUEST, worker.out);
+		return false;
+	}
+	int dims = maps[header.map].first;
+	int index = maps[header.map].second;
+	switch(header.op) {
+	case ServerOp::MAP_DIMS:
+		worker.out.push_back(dims);
+		return writeResponse(fd, ServerStatus::OK, worker.out);
+	case ServerOp::LINK_DISTANCES:
+		if (header.count < 0 || header.count > MAX_REQUEST_QUERIES) break;
+		worker.in.resize(2 * dims * header.count);
+		if (!readAll(fd, worker.in.data(), worker.in.size() * sizeof(int32_t))) return false;
+		if (dims == 2) {
+			runQueries(planes[index], worker.planes[index], worker.in, header.maxLinks, worker.out);
+		} else {
+			runQueries(volumes[index], worker.volumes[index], worker.in, header.maxLinks, worker.out);
+		}
+		return writeResponse(fd, ServerStatus::OK, worker.out);
+	}
+	writeResponse(fd, ServerStatus::BAD_REQUEST, worker.out);
+	return false;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "path.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Binary protocol of `LinkServer`. The fields are 32-bit integers in host
+// byte order. A client sends a `RequestHeader` followed by the payload of the
+// operation, and the server answers with a `ResponseHeader` followed by
+// `count` result values. Any number of requests may be sent over one
+// connection. The server closes the connection after a malformed request.
+enum class ServerOp: int32_t {
+	// Payload: `count` queries, each given by the start and the end point of
+	// `dims` coordinates. Results: the `linkDistance` of each query with
+	// `RequestHeader::maxLinks` as the link budget.
+	LINK_DISTANCES = 1,
+	// Payload: none. Results: the number of dimensions of the map.
+	MAP_DIMS = 2,
+};
+
+enum class ServerStatus: int32_t {
+	OK = 0,
+	// Unknown operation or map, or too many queries.
+	BAD_REQUEST = 1,
+};
+
+struct RequestHeader {
+	ServerOp op;
+	// Index of the map in the order the maps were added.
+	int32_t map;
+	int32_t count;
+	int32_t maxLinks;
+};
+
+struct ResponseHeader {
+	ServerStatus status;
+	int32_t count;
+};
+
+// Largest `count` of a LINK_DISTANCES request.
+constexpr int32_t MAX_REQUEST_QUERIES = 1<<16;
+
+// Limits on how long `LinkServer` waits for a client.
+struct ServerTimeouts {
+	// A connection with no request for this long is closed.
+	std::chrono::milliseconds idle = std::chrono::seconds(60);
+	// A connection that stalls for this long in the middle of a request or a
+	// response is closed.
+	std::chrono::milliseconds transfer = std::chrono::seconds(5);
+};
+
+// Server answering link distance queries on a fixed set of maps over a Unix
+// domain socket.
+//
+// The requests are answered by a pool of worker threads. A worker answers one
+// request and hands the connection back to the thread running `serve`, which
+// waits for the next request on all the idle connections at once. Idle or
+// slow clients therefore do not hold workers. Every worker keeps a
+// `QueryWorkspace` per map, so the queries reuse the buffers of earlier ones.
+// The sweeps of each query run on the global `ThreadPool`.
+class LinkServer {
+public:
+	// Adds a map served to the clients. Must be called before `serve`.
+	// Returns the index of the map.
+	int addMap(LinkIndex<2> index);
+	int addMap(LinkIndex<3> index);
+
+	// Must be called before `serve`.
+	void setTimeouts(const ServerTimeouts& t) { timeouts = t; }
+
+	// Listens on a new socket at `path`, replacing an existing file, and
+	// serves the connections with `workers` threads until `stop` is called.
+	// Returns false and sets `error` if the socket cannot be created.
+	bool serve(const std::string& path, int workers, std::string& error);
+
+	// Makes `serve` stop accepting connections and return once the requests
+	// being served are answered. May be called from any thread, also before
+	// `serve`.
+	void stop();
+
+private:
+	struct Worker;
+	typedef std::chrono::steady_clock Clock;
+
+	void workerLoop();
+	// Waits for new connections and for requests on the idle connections,
+	// and queues them for the workers, until `stop` is called.
+	void pollLoop(int listenSocket, int wakeSocket);
+	// Answers a single request. Returns false if the connection should be
+	// closed.
+	bool handleRequest(int fd, Worker& worker);
+	// Wakes up `pollLoop`. Called with `mutex` held.
+	void wakePoller();
+
+	std::vector<LinkIndex<2>> planes;
+	std::vector<LinkIndex<3>> volumes;
+	// Number of dimensions of each map and its index in `planes` or
+	// `volumes`.
+	std::vector<std::pair<int, int>> maps;
+
+	ServerTimeouts timeouts;
+
+	std::atomic<bool> stopping{false};
+	// Write end of the pipe that wakes up `pollLoop`, or -1 when not serving.
+	// Guarded by `mutex`.
+	int wakeFd = -1;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	// Connections with a request waiting for a worker.
+	std::deque<int> pending;
+	// Connections being served, shut down by `stop`.
+	std::unordered_set<int> active;
+	// Connections handed back by the workers, with the time they became idle.
+	std::vector<std::pair<int, Clock::time_point>> idle;
+};
@@ -0,0 +1,98 @@
+// Daemon serving link distance queries on maps loaded at startup. See
+// `LinkServer` for the protocol. With -p, writes the metrics of the queries
+// to METRICS_FILE in the Prometheus text format every 10 seconds.
+//
+// Usage: linkServer [-j WORKERS] [-p METRICS_FILE] SOCKET MAP...
+
+#include "linkServer.hpp"
+#include "mapFile.hpp"
+#include "metrics.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <pthread.h>
+
+using namespace std;
+
+namespace {
+
+int usage() {
+	cerr << "usage: linkServer [-j WORKERS] [-p METRICS_FILE] SOCKET MAP...\n";
+	return 2;
+}
+
+// Loads the map file at `path` and adds its index to `server`.
+bool loadMap(LinkServer& server, const string& path) {
+	ifstream in(path);
+	if (!in) {
+		cerr << path << ": cannot open\n";
+		return false;
+	}
+	MapFile map;
+	string error;
+	if (!readMap(in, map, error)) {
+		cerr << path << ": " << error << '\n';
+		return false;
+	}
+	auto start = chrono::steady_clock::now();
+	int id = map.dims == 2
+		? server.addMap(buildLinkIndex(planeObstacles(map)))
+		: server.addMap(buildLinkIndex(volumeObstacles(map)));
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	cerr << "map " << id << ": " << path << ", " << map.dims << "D, built in " << elapsed.count() << " s\n";
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	int workers = thread::hardware_concurrency();
+	string metricsPath;
+	int arg = 1;
+	for(; arg+1 < argc && argv[arg][0] == '-'; arg += 2) {
+		if (strcmp(argv[arg], "-j") == 0) {
+			workers = atoi(argv[arg+1]);
+		} else if (strcmp(argv[arg], "-p") == 0) {
+			metricsPath = argv[arg+1];
+		} else {
+			return usage();
+		}
+	}
+	if (argc - arg < 2 || workers <= 0) return usage();
+	string socketPath = argv[arg++];
+
+	// Handle the termination signals in a dedicated thread. The mask is
+	// inherited by the threads started later.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	unique_ptr<MetricsExporter> exporter;
+	if (!metricsPath.empty()) exporter.reset(new MetricsExporter(metricsPath, chrono::seconds(10)));
+	LinkServer server;
+	for(; arg < argc; ++arg) {
+		if (!loadMap(server, argv[arg])) return 1;
+	}
+	thread signalThread([&] {
+		int sig;
+		sigwait(&signals, &sig);
+		server.stop();
+	});
+	signalThread.detach();
+
+	string error;
+	if (!server.serve(socketPath, workers, error)) {
+		cerr << error << '\n';
+		return 1;
+	}
+	return 0;
+}
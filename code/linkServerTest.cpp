@@ -0,0 +1,195 @@
+#include "linkServer.hpp"
+#include "obstacles.hpp"
+
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+// Runs a server on a temporary socket for the duration of a test.
+class ServerFixture: public ::testing::Test {
+protected:
+	void start(int workers) {
+		path = "/tmp/linkServerTest." + to_string(getpid()) + ".sock";
+		thread = std::thread([this, workers] {
+			string error;
+			EXPECT_TRUE(server.serve(path, workers, error)) << error;
+		});
+	}
+	void TearDown() override {
+		server.stop();
+		if (thread.joinable()) thread.join();
+	}
+
+	// Connects to the server, retrying until it listens.
+	int connectClient() {
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, path.c_str());
+		for(int attempt=0; attempt<1000; ++attempt) {
+			int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+			close(fd);
+			this_thread::sleep_for(chrono::milliseconds(5));
+		}
+		ADD_FAILURE() << "cannot connect to " << path;
+		return -1;
+	}
+
+	// Sends a request and returns the status and the results of the response,
+	// or BAD_REQUEST with no results if the connection was closed.
+	pair<ServerStatus, vector<int32_t>> request(int fd, ServerOp op, int map, int count, int maxLinks,
+			const vector<int32_t>& payload = {}) {
+		RequestHeader header{op, map, count, maxLinks};
+		EXPECT_EQ(write(fd, &header, sizeof(header)), (ssize_t)sizeof(header));
+		if (!payload.empty()) {
+			size_t size = payload.size() * sizeof(int32_t);
+			EXPECT_EQ(write(fd, payload.data(), size), (ssize_t)size);
+		}
+		ResponseHeader response;
+		if (!readAll(fd, &response, sizeof(response))) return {ServerStatus::BAD_REQUEST, {}};
+		vector<int32_t> results(response.count);
+		EXPECT_TRUE(readAll(fd, results.data(), results.size() * sizeof(int32_t)));
+		return {response.status, results};
+	}
+
+	static bool readAll(int fd, void* data, size_t size) {
+		char* p = static_cast<char*>(data);
+		while(size > 0) {
+			ssize_t n = read(fd, p, size);
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	LinkServer server;
+	string path;
+	std::thread thread;
+};
+
+vector<string> randomGrid(int w, int h, mt19937& rng) {
+	vector<string> grid(h, string(w, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	return grid;
+}
+
+TEST_F(ServerFixture, LinkDistances) {
+	mt19937 rng(0);
+	auto grid = randomGrid(16, 16, rng);
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+	vector<int32_t> payload;
+	vector<int32_t> expected;
+	for(int i=0; i<50; ++i) {
+		Point<2> s{int(rng()%16 + 1), int(rng()%16 + 1)};
+		Point<2> e{int(rng()%16 + 1), int(rng()%16 + 1)};
+		payload.insert(payload.end(), {s[0], s[1], e[0], e[1]});
+		expected.push_back(linkDistance(index, s, e));
+	}
+	server.addMap(move(index));
+	server.addMap(buildLinkIndex(makeObstaclesForVolume({{"..", ".."}, {"..", ".."}})));
+	start(2);
+
+	vector<std::thread> clients;
+	for(int c=0; c<4; ++c) {
+		clients.emplace_back([&] {
+			int fd = connectClient();
+			for(int round=0; round<3; ++round) {
+				auto res = request(fd, ServerOp::LINK_DISTANCES, 0, expected.size(), -1, payload);
+				EXPECT_EQ(res.first, ServerStatus::OK);
+				EXPECT_EQ(res.second, expected);
+			}
+			close(fd);
+		});
+	}
+	for(std::thread& t: clients) t.join();
+
+	int fd = connectClient();
+	auto dims = request(fd, ServerOp::MAP_DIMS, 1, 0, 0);
+	EXPECT_EQ(dims.first, ServerStatus::OK);
+	EXPECT_EQ(dims.second, vector<int32_t>({3}));
+	auto single = request(fd, ServerOp::LINK_DISTANCES, 1, 1, -1, {1, 1, 1, 2, 2, 2});
+	EXPECT_EQ(single.second, vector<int32_t>({3}));
+	close(fd);
+}
+
+TEST_F(ServerFixture, BadRequestClosesConnection) {
+	server.addMap(buildLinkIndex(makeObstaclesForPlane({"..."})));
+	start(1);
+	int fd = connectClient();
+	auto res = request(fd, ServerOp::MAP_DIMS, 5, 0, 0);
+	EXPECT_EQ(res.first, ServerStatus::BAD_REQUEST);
+	char c;
+	EXPECT_EQ(read(fd, &c, 1), 0);
+	close(fd);
+
+	fd = connectClient();
+	res = request(fd, ServerOp::LINK_DISTANCES, 0, MAX_REQUEST_QUERIES + 1, -1);
+	EXPECT_EQ(res.first, ServerStatus::BAD_REQUEST);
+	close(fd);
+}
+
+TEST_F(ServerFixture, StopWithOpenConnection) {
+	server.addMap(buildLinkIndex(makeObstaclesForPlane({"..."})));
+	start(1);
+	int fd = connectClient();
+	auto res = request(fd, ServerOp::MAP_DIMS, 0, 0, 0);
+	EXPECT_EQ(res.first, ServerStatus::OK);
+	server.stop();
+	thread.join();
+	char c;
+	EXPECT_EQ(read(fd, &c, 1), 0);
+	close(fd);
+}
+
+TEST_F(ServerFixture, IdleClientsDoNotHoldWorkers) {
+	ServerTimeouts timeouts;
+	timeouts.transfer = chrono::milliseconds(100);
+	server.setTimeouts(timeouts);
+	server.addMap(buildLinkIndex(makeObstaclesForPlane({"..."})));
+	start(1);
+	int idle = connectClient();
+	EXPECT_EQ(request(idle, ServerOp::MAP_DIMS, 0, 0, 0).first, ServerStatus::OK);
+	// Stalls in the middle of a request.
+	int stalled = connectClient();
+	int32_t partial = 2;
+	EXPECT_EQ(write(stalled, &partial, sizeof(partial)), (ssize_t)sizeof(partial));
+	int fd = connectClient();
+	for(int i=0; i<3; ++i) {
+		EXPECT_EQ(request(fd, ServerOp::MAP_DIMS, 0, 0, 0).second, vector<int32_t>({2}));
+	}
+	char c;
+	EXPECT_EQ(read(stalled, &c, 1), 0);
+	EXPECT_EQ(request(idle, ServerOp::MAP_DIMS, 0, 0, 0).second, vector<int32_t>({2}));
+	close(idle);
+	close(stalled);
+	close(fd);
+}
+
+TEST_F(ServerFixture, IdleTimeout) {
+	ServerTimeouts timeouts;
+	timeouts.idle = chrono::milliseconds(50);
+	server.setTimeouts(timeouts);
+	server.addMap(buildLinkIndex(makeObstaclesForPlane({"..."})));
+	start(1);
+	int fd = connectClient();
+	EXPECT_EQ(request(fd, ServerOp::MAP_DIMS, 0, 0, 0).first, ServerStatus::OK);
+	char c;
+	EXPECT_EQ(read(fd, &c, 1), 0);
+	close(fd);
+}
+
+} // namespace
@@ -0,0 +1,62 @@
+#include "mapFile.hpp"
+
+#include "obstacles.hpp"
+
+using namespace std;
+
+bool readMap(istream& in, MapFile& map, string& error) {
+	map = MapFile();
+	string line;
+	if (!getline(in, line) || !(line == "2" || line == "3" || line == "2\r" || line == "3\r")) {
+		error = "the first line must be the number of dimensions, 2 or 3";
+		return false;
+	}
+	map.dims = line[0] - '0';
+	map.planes.emplace_back();
+	for(int lineNumber=2; getline(in, line); ++lineNumber) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (line.empty()) {
+			if (!map.planes.back().empty()) map.planes.emplace_back();
+			continue;
+		}
+		if (line.find_first_not_of("#.") != string::npos) {
+			error = "line " + to_string(lineNumber) + ": unexpected character";
+			return false;
+		}
+		const vector<string>& first = map.planes[0];
+		if (!first.empty() && line.size() != first[0].size()) {
+			error = "line " + to_string(lineNumber) + ": rows have different lengths";
+			return false;
+		}
+		map.planes.back().push_back(line);
+	}
+	if (map.planes.back().empty()) map.planes.pop_back();
+	if (map.planes.empty()) {
+		error = "the map has no rows";
+		return false;
+	}
+	for(const vector<string>& plane: map.planes) {
+		if (plane.size() != map.planes[0].size()) {
+			error = "planes have different numbers of rows";
+			return false;
+		}
+	}
+	if (map.dims == 2 && map.planes.size() != 1) {
+		error = "2D maps must not have empty lines between rows";
+		return false;
+	}
+	// `makeObstaclesForVolume` handles only volumes as deep as they are high.
+	if (map.dims == 3 && map.planes.size() != map.planes[0].size()) {
+		error = "3D maps must have as many planes as rows per plane";
+		return false;
+	}
+	return true;
+}
+
+ObstacleSet<2> planeObstacles(const MapFile& map) {
+	return makeObstaclesForPlane(map.planes[0]);
+}
+
+ObstacleSet<3> volumeObstacles(const MapFile& map) {
+	return makeObstaclesForVolume(map.planes);
+}
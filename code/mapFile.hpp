@@ -0,0 +1,28 @@
+#pragma once
+
+#include "decomposition.hpp"
+
+#include <istream>
+#include <string>
+#include <vector>
+
+// Grid of unit cells read by `readMap`, where '#' marks blocked cells and '.'
+// free cells. The free cell at column x, row y and plane z is the point
+// (x+1, y+1, z+1), as with `makeObstaclesForPlane` and
+// `makeObstaclesForVolume`.
+struct MapFile {
+	// Number of dimensions, 2 or 3.
+	int dims = 0;
+	// Planes of rows. 2D maps have a single plane.
+	std::vector<std::vector<std::string>> planes;
+};
+
+// Reads a map from `in`. The first line holds the number of dimensions, and
+// the following lines hold the rows. The planes of 3D maps are separated by
+// empty lines. Returns false and sets `error` if the map is malformed.
+bool readMap(std::istream& in, MapFile& map, std::string& error);
+
+// Returns the obstacles enclosing the free cells of a 2D `map`.
+ObstacleSet<2> planeObstacles(const MapFile& map);
+// Returns the obstacles enclosing the free cells of a 3D `map`.
+ObstacleSet<3> volumeObstacles(const MapFile& map);
@@ -0,0 +1,55 @@
+#include "mapFile.hpp"
+#include "obstacles.hpp"
+
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+bool parse(const string& text, MapFile& map, string& error) {
+	istringstream in(text);
+	return readMap(in, map, error);
+}
+
+TEST(MapFileTest, ReadPlane) {
+	MapFile map;
+	string error;
+	ASSERT_TRUE(parse("2\n..#\n.#.\r\n", map, error)) << error;
+	EXPECT_EQ(map.dims, 2);
+	ASSERT_EQ(map.planes.size(), 1u);
+	EXPECT_EQ(map.planes[0], vector<string>({"..#", ".#."}));
+	auto obstacles = planeObstacles(map);
+	auto expected = makeObstaclesForPlane({"..#", ".#."});
+	ASSERT_EQ(obstacles.size(), expected.size());
+	for(size_t i=0; i<obstacles.size(); ++i) {
+		EXPECT_EQ(obstacles[i].box, expected[i].box);
+		EXPECT_EQ(obstacles[i].direction, expected[i].direction);
+	}
+}
+
+TEST(MapFileTest, ReadVolume) {
+	MapFile map;
+	string error;
+	ASSERT_TRUE(parse("3\n..\n.#\n\n#.\n..\n", map, error)) << error;
+	EXPECT_EQ(map.dims, 3);
+	ASSERT_EQ(map.planes.size(), 2u);
+	EXPECT_EQ(map.planes[1], vector<string>({"#.", ".."}));
+	EXPECT_FALSE(volumeObstacles(map).empty());
+}
+
+TEST(MapFileTest, Malformed) {
+	MapFile map;
+	string error;
+	EXPECT_FALSE(parse("4\n..\n", map, error));
+	EXPECT_FALSE(parse("2\n", map, error));
+	EXPECT_FALSE(parse("2\n..\n.x\n", map, error));
+	EXPECT_FALSE(parse("2\n..\n...\n", map, error));
+	EXPECT_FALSE(parse("2\n..\n\n..\n", map, error));
+	EXPECT_FALSE(parse("3\n..\n..\n\n..\n", map, error));
+	EXPECT_FALSE(parse("3\n..\n..\n", map, error));
+}
+
+} // namespace
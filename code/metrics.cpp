@@ -0,0 +1,264 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+typedef atomic<uint64_t> Counter;
+
+// Adds to a counter that only the calling thread writes.
+void bump(Counter& counter, uint64_t n = 1) {
+	counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+uint64_t read(const Counter& counter) {
+	return counter.load(memory_order_relaxed);
+}
+
+// Counters of a `LatencyHistogram` written by a single thread.
+struct SharedHistogram {
+	Counter counts[LatencyHistogram::BUCKETS]{};
+	Counter sum{0};
+	Counter maximum{0};
+
+	void add(uint64_t nanos) {
+		bump(counts[LatencyHistogram::bucket(nanos)]);
+		bump(sum, nanos);
+		if (nanos > read(maximum)) maximum.store(nanos, memory_order_relaxed);
+	}
+	void addTo(LatencyHistogram& h) const {
+		array<uint64_t, LatencyHistogram::BUCKETS> values;
+		for(int i=0; i<LatencyHistogram::BUCKETS; ++i) values[i] = read(counts[i]);
+		h.addCounts(values, read(sum), read(maximum));
+	}
+};
+
+const char* pathName(int path) {
+	switch((QueryPath)path) {
+	case QueryPath::TRIVIAL: return "trivial";
+	case QueryPath::UNREACHABLE: return "unreachable";
+	case QueryPath::SHORT: return "short";
+	default: return "illuminated";
+	}
+}
+
+double fraction(uint64_t part, uint64_t whole) {
+	return whole ? (double)part / whole : 0;
+}
+
+void writeHeader(ostream& out, const char* name, const char* type, const char* help) {
+	out << "# HELP " << name << ' ' << help << '\n';
+	out << "# TYPE " << name << ' ' << type << '\n';
+}
+
+// Writes the series of `h` with the given labels, which are empty or end in
+// a comma. Has a bucket for each power of two from about a microsecond to
+// about 9 minutes. The bounds are exclusive by a nanosecond, which does not
+// matter at this resolution.
+void writeHistogramSeries(ostream& out, const char* name, const string& labels, const LatencyHistogram& h) {
+	const int firstExp = 10, lastExp = 39;
+	uint64_t cumulative = 0;
+	int i = 0;
+	for(int exp=firstExp; exp<=lastExp; ++exp) {
+		for(; LatencyHistogram::bucketEnd(i) <= (1ull << exp); ++i) cumulative += h.bucketCount(i);
+		out << name << "_bucket{" << labels << "le=\"" << (1ull << exp) * 1e-9 << "\"} " << cumulative << '\n';
+	}
+	out << name << "_bucket{" << labels << "le=\"+Inf\"} " << h.count() << '\n';
+	string braced = labels.empty() ? "" : "{" + labels.substr(0, labels.size()-1) + "}";
+	out << name << "_sum" << braced << ' ' << h.sum() * 1e-9 << '\n';
+	out << name << "_count" << braced << ' ' << h.count() << '\n';
+}
+
+void writeHistogram(ostream& out, const char* name, const char* help, const LatencyHistogram& h) {
+	writeHeader(out, name, "histogram", help);
+	writeHistogramSeries(out, name, "", h);
+}
+
+string buildLabels(int dims, bool update) {
+	return "dims=\"" + to_string(dims) + "\",kind=\"" + (update ? "update" : "build") + "\",";
+}
+
+} // namespace
+
+uint64_t MetricsSnapshot::queryCount() const {
+	uint64_t count = 0;
+	for(uint64_t n: queries) count += n;
+	return count;
+}
+
+struct LinkMetrics::Shard {
+	SharedHistogram lookup;
+	SharedHistogram illumination;
+	SharedHistogram total;
+	Counter queries[MetricsSnapshot::PATHS]{};
+	Counter cacheHits{0};
+	Counter cacheMisses{0};
+};
+
+LinkMetrics::LinkMetrics() {}
+LinkMetrics::~LinkMetrics() {}
+
+LinkMetrics& LinkMetrics::global() {
+	static LinkMetrics* metrics = new LinkMetrics();
+	return *metrics;
+}
+
+// There is a single instance of `LinkMetrics`, so one pointer per thread is
+// enough.
+LinkMetrics::Shard& LinkMetrics::localShard() {
+	thread_local Shard* shard = nullptr;
+	if (!shard) {
+		lock_guard<std::mutex> lock(mutex);
+		shards.emplace_back(new Shard());
+		shard = shards.back().get();
+	}
+	return *shard;
+}
+
+void LinkMetrics::recordQuery(QueryPath path, uint64_t lookupNanos, uint64_t illuminationNanos) {
+	Shard& shard = localShard();
+	shard.lookup.add(lookupNanos);
+	if (path == QueryPath::ILLUMINATED) shard.illumination.add(illuminationNanos);
+	shard.total.add(lookupNanos + illuminationNanos);
+	bump(shard.queries[(int)path]);
+}
+
+void LinkMetrics::recordCacheLookup(bool hit) {
+	Shard& shard = localShard();
+	bump(hit ? shard.cacheHits : shard.cacheMisses);
+}
+
+void LinkMetrics::recordIndexBuild(const IndexBuildTime& build) {
+	lock_guard<std::mutex> lock(mutex);
+	IndexBuildStats& stats = builds[build.dims-2][build.update];
+	stats.time.add(build.seconds * 1e9);
+	stats.last = build;
+}
+
+MetricsSnapshot LinkMetrics::snapshot() const {
+	MetricsSnapshot s;
+	s.time = chrono::steady_clock::now();
+	lock_guard<std::mutex> lock(mutex);
+	for(const unique_ptr<Shard>& shard: shards) {
+		shard->lookup.addTo(s.lookup);
+		shard->illumination.addTo(s.illumination);
+		shard->total.addTo(s.total);
+		for(int i=0; i<MetricsSnapshot::PATHS; ++i) s.queries[i] += read(shard->queries[i]);
+		s.cacheHits += read(shard->cacheHits);
+		s.cacheMisses += read(shard->cacheMisses);
+	}
+	for(int d=0; d<2; ++d) {
+		for(int u=0; u<2; ++u) s.builds[d][u] = builds[d][u];
+	}
+	return s;
+}
+
+void writePrometheus(ostream& out, const MetricsSnapshot& now, const MetricsSnapshot* previous) {
+	streamsize precision = out.precision(9);
+	writeHistogram(out, "minlink_query_seconds",
+			"Time of link distance queries on a decomposition.", now.total);
+	writeHistogram(out, "minlink_query_lookup_seconds",
+			"Time of the cell lookup and the fast path checks of link distance queries.", now.lookup);
+	writeHistogram(out, "minlink_query_illumination_seconds",
+			"Time of the illumination rounds of link distance queries.", now.illumination);
+
+	writeHeader(out, "minlink_queries_total", "counter", "Link distance queries by how they were answered.");
+	for(int i=0; i<MetricsSnapshot::PATHS; ++i) {
+		out << "minlink_queries_total{path=\"" << pathName(i) << "\"} " << now.queries[i] << '\n';
+	}
+	uint64_t queries = now.queryCount();
+	uint64_t illuminated = now.queries[(int)QueryPath::ILLUMINATED];
+	writeHeader(out, "minlink_fast_path_ratio", "gauge", "Fraction of link distance queries answered without illumination.");
+	out << "minlink_fast_path_ratio " << fraction(queries - illuminated, queries) << '\n';
+
+	double rate = 0;
+	if (previous) {
+		double seconds = chrono::duration<double>(now.time - previous->time).count();
+		uint64_t answered = queries + now.cacheHits - previous->queryCount() - previous->cacheHits;
+		if (seconds > 0) rate = answered / seconds;
+	}
+	writeHeader(out, "minlink_queries_per_second", "gauge",
+			"Link distance queries answered per second since the previous export, including cache hits.");
+	out << "minlink_queries_per_second " << rate << '\n';
+
+	writeHeader(out, "minlink_cache_hits_total", "counter", "Link distance cache lookups that found the result.");
+	out << "minlink_cache_hits_total " << now.cacheHits << '\n';
+	writeHeader(out, "minlink_cache_misses_total", "counter", "Link distance cache lookups that ran the query.");
+	out << "minlink_cache_misses_total " << now.cacheMisses << '\n';
+	writeHeader(out, "minlink_cache_hit_ratio", "gauge", "Fraction of link distance cache lookups that found the result.");
+	out << "minlink_cache_hit_ratio " << fraction(now.cacheHits, now.cacheHits + now.cacheMisses) << '\n';
+
+	// The builds are labeled by the dimension and the kind only, as every
+	// update gives the index a new id.
+	writeHeader(out, "minlink_index_build_seconds", "histogram", "Time taken to build or update a link index.");
+	for(int d=0; d<2; ++d) {
+		for(int u=0; u<2; ++u) {
+			const IndexBuildStats& b = now.builds[d][u];
+			if (b.time.count()) writeHistogramSeries(out, "minlink_index_build_seconds", buildLabels(d+2, u), b.time);
+		}
+	}
+	auto writeLast = [&](const char* name, const char* help, double (*value)(const IndexBuildTime&)) {
+		writeHeader(out, name, "gauge", help);
+		for(int d=0; d<2; ++d) {
+			for(int u=0; u<2; ++u) {
+				const IndexBuildStats& b = now.builds[d][u];
+				if (!b.time.count()) continue;
+				string labels = buildLabels(d+2, u);
+				out << name << '{' << labels.substr(0, labels.size()-1) << "} " << value(b.last) << '\n';
+			}
+		}
+	};
+	writeLast("minlink_index_last_build_seconds", "Time taken by the most recent build or update of a link index.",
+			[](const IndexBuildTime& b) { return b.seconds; });
+	writeLast("minlink_index_last_cells", "Number of cells in the most recently built or updated link index.",
+			[](const IndexBuildTime& b) { return (double)b.cells; });
+	out.precision(precision);
+}
+
+MetricsExporter::MetricsExporter(string path, chrono::milliseconds interval):
+	path(move(path)), interval(interval)
+{
+	worker = thread([this] {
+		unique_lock<std::mutex> lock(mutex);
+		while(!wake.wait_for(lock, this->interval, [this]{ return stopping; })) {
+			lock.unlock();
+			write();
+			lock.lock();
+		}
+	});
+}
+
+MetricsExporter::~MetricsExporter() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+	write();
+}
+
+bool MetricsExporter::write() {
+	lock_guard<std::mutex> lock(writeMutex);
+	MetricsSnapshot now = LinkMetrics::global().snapshot();
+	ostringstream text;
+	writePrometheus(text, now, hasPrevious ? &previous : nullptr);
+	previous = move(now);
+	hasPrevious = true;
+
+	string tmpPath = path + ".tmp";
+	{
+		ofstream out(tmpPath);
+		out << text.str();
+		out.close();
+		if (!out) {
+			remove(tmpPath.c_str());
+			return false;
+		}
+	}
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
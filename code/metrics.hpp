@@ -0,0 +1,128 @@
+#pragma once
+
+#include "LatencyHistogram.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How a `linkDistance` query on a decomposition was answered. All but
+// ILLUMINATED are fast paths decided by the cell lookup.
+enum class QueryPath {
+	// The end point is in the unit box of the start point.
+	TRIVIAL,
+	// The points are outside free space or in different components.
+	UNREACHABLE,
+	// The distance is at most 2 and found without illumination.
+	SHORT,
+	ILLUMINATED,
+	COUNT
+};
+
+// Time taken to build or update a `LinkIndex`.
+struct IndexBuildTime {
+	// `LinkIndex::id` of the result.
+	unsigned long id = 0;
+	int dims = 0;
+	// Number of cells in the decomposition.
+	long cells = 0;
+	bool update = false;
+	double seconds = 0;
+};
+
+// Builds or updates, one or the other, of the link indexes of one dimension.
+struct IndexBuildStats {
+	LatencyHistogram time;
+	// The most recent one, or all zero if there is none.
+	IndexBuildTime last;
+};
+
+// Totals of the recorded metrics at some point in time.
+struct MetricsSnapshot {
+	static constexpr int PATHS = (int)QueryPath::COUNT;
+
+	// Time of the cell lookup and the fast path checks of every query.
+	LatencyHistogram lookup;
+	// Time of the illumination rounds of the illuminated queries.
+	LatencyHistogram illumination;
+	// Time of every query on a decomposition.
+	LatencyHistogram total;
+	uint64_t queries[PATHS] = {};
+	uint64_t cacheHits = 0;
+	uint64_t cacheMisses = 0;
+	// Index builds by the dimension minus 2 and whether they were updates.
+	IndexBuildStats builds[2][2];
+	std::chrono::steady_clock::time_point time;
+
+	uint64_t queryCount() const;
+};
+
+// Operational metrics of the link distance queries of the process.
+//
+// Each thread records into a shard that only it writes, so recording takes no
+// locks and no atomic read-modify-write instructions. The counters are relaxed
+// atomics so that `snapshot` can sum the shards while they are written; a
+// snapshot may miss the updates made during it. Shards of exited threads are
+// kept, so the totals never decrease.
+class LinkMetrics {
+public:
+	// The metrics of the process. Never destroyed, so threads may record
+	// until the process exits.
+	static LinkMetrics& global();
+
+	// Records a query answered by `path`. `illuminationNanos` is 0 for the
+	// fast paths.
+	void recordQuery(QueryPath path, uint64_t lookupNanos, uint64_t illuminationNanos);
+	void recordCacheLookup(bool hit);
+	// Takes a lock, as builds are rare.
+	void recordIndexBuild(const IndexBuildTime& build);
+
+	MetricsSnapshot snapshot() const;
+
+private:
+	struct Shard;
+
+	LinkMetrics();
+	~LinkMetrics();
+	Shard& localShard();
+
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<Shard>> shards;
+	IndexBuildStats builds[2][2];
+};
+
+// Writes `now` in the Prometheus text exposition format. The query rate is
+// computed against `previous`, or reported as 0 if `previous` is null.
+void writePrometheus(std::ostream& out, const MetricsSnapshot& now, const MetricsSnapshot* previous);
+
+// Writes `LinkMetrics::global()` to a file in the Prometheus text format
+// every `interval` until destroyed, and once more when destroyed. The file is
+// replaced by renaming a temporary file over it, so a reader never sees a
+// partially written file.
+class MetricsExporter {
+public:
+	MetricsExporter(std::string path, std::chrono::milliseconds interval);
+	~MetricsExporter();
+
+	// Writes the file now. Returns false if it could not be written.
+	bool write();
+
+private:
+	std::string path;
+	std::chrono::milliseconds interval;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	// Serializes `write` and guards `previous`.
+	std::mutex writeMutex;
+	bool hasPrevious = false;
+	MetricsSnapshot previous;
+	std::thread worker;
+};
@@ -0,0 +1,159 @@
+#include "metrics.hpp"
+#include "obstacles.hpp"
+#include "path.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+uint64_t queries(const MetricsSnapshot& s, QueryPath path) {
+	return s.queries[(int)path];
+}
+
+TEST(MetricsTest, RecordsQueryPaths) {
+	LinkMetrics& metrics = LinkMetrics::global();
+	MetricsSnapshot before = metrics.snapshot();
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane({"...", "##.", "..."}));
+	EXPECT_EQ(linkDistance(index, {1,1}, {1,1}), 0);
+	EXPECT_EQ(linkDistance(index, {1,1}, {10,10}), -1);
+	EXPECT_EQ(linkDistance(index, {1,1}, {3,1}), 1);
+	EXPECT_EQ(linkDistance(index, {1,1}, {1,3}), 3);
+	MetricsSnapshot after = metrics.snapshot();
+
+	for(QueryPath path: {QueryPath::TRIVIAL, QueryPath::UNREACHABLE, QueryPath::SHORT, QueryPath::ILLUMINATED}) {
+		EXPECT_EQ(queries(after, path), queries(before, path) + 1) << (int)path;
+	}
+	EXPECT_EQ(after.total.count(), before.total.count() + 4);
+	EXPECT_EQ(after.lookup.count(), before.lookup.count() + 4);
+	EXPECT_EQ(after.illumination.count(), before.illumination.count() + 1);
+	EXPECT_GE(after.total.sum(), after.illumination.sum());
+
+	EXPECT_EQ(after.builds[0][0].time.count(), before.builds[0][0].time.count() + 1);
+	const IndexBuildTime& build = after.builds[0][0].last;
+	EXPECT_EQ(build.id, index.id);
+	EXPECT_EQ(build.dims, 2);
+	EXPECT_EQ(build.cells, (long)index.decomposition.size());
+	EXPECT_FALSE(build.update);
+}
+
+TEST(MetricsTest, IndexUpdates) {
+	LinkMetrics& metrics = LinkMetrics::global();
+	MetricsSnapshot before = metrics.snapshot();
+	LinkIndex<3> index = buildLinkIndex(makeObstaclesForVolume({{"..", ".."}, {"..", ".."}}));
+	for(int i=0; i<3; ++i) updateLinkIndex(index, {}, {});
+	MetricsSnapshot after = metrics.snapshot();
+	EXPECT_EQ(after.builds[1][1].time.count(), before.builds[1][1].time.count() + 3);
+	EXPECT_EQ(after.builds[1][1].last.id, index.id);
+	EXPECT_TRUE(after.builds[1][1].last.update);
+
+	// Every update has its own id, but the series do not depend on it.
+	ostringstream out;
+	writePrometheus(out, after, nullptr);
+	string text = out.str();
+	EXPECT_EQ(text.find("index=\""), string::npos);
+	size_t first = text.find("minlink_index_last_build_seconds{dims=\"3\",kind=\"update\"}");
+	ASSERT_NE(first, string::npos);
+	EXPECT_EQ(text.find("minlink_index_last_build_seconds{dims=\"3\",kind=\"update\"}", first+1), string::npos);
+}
+
+TEST(MetricsTest, CacheLookups) {
+	LinkDistanceCache<2> cache(8);
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane({"...", "##.", "..."}));
+	MetricsSnapshot before = LinkMetrics::global().snapshot();
+	cache.linkDistance(index, {1,1}, {1,3});
+	cache.linkDistance(index, {1,1}, {1,3});
+	cache.linkDistance(index, {1,1}, {1,3});
+	MetricsSnapshot after = LinkMetrics::global().snapshot();
+	EXPECT_EQ(after.cacheHits, before.cacheHits + 2);
+	EXPECT_EQ(after.cacheMisses, before.cacheMisses + 1);
+	EXPECT_EQ(after.queryCount(), before.queryCount() + 1);
+}
+
+TEST(MetricsTest, SumsThreadShards) {
+	LinkMetrics& metrics = LinkMetrics::global();
+	MetricsSnapshot before = metrics.snapshot();
+	vector<thread> threads;
+	for(int t=0; t<4; ++t) {
+		threads.emplace_back([&] {
+			for(int i=0; i<1000; ++i) metrics.recordQuery(QueryPath::SHORT, i, 0);
+		});
+	}
+	for(thread& t: threads) t.join();
+	MetricsSnapshot after = metrics.snapshot();
+	EXPECT_EQ(queries(after, QueryPath::SHORT), queries(before, QueryPath::SHORT) + 4000);
+	EXPECT_EQ(after.lookup.sum(), before.lookup.sum() + 4 * 999 * 1000 / 2);
+}
+
+TEST(MetricsTest, PrometheusText) {
+	MetricsSnapshot previous, now;
+	now.time = previous.time + chrono::seconds(2);
+	previous.queries[(int)QueryPath::SHORT] = 4;
+	now.queries[(int)QueryPath::SHORT] = 10;
+	now.queries[(int)QueryPath::ILLUMINATED] = 6;
+	now.cacheHits = 4;
+	now.cacheMisses = 12;
+	now.total.add(500);
+	now.total.add(3000);
+	now.total.add(1ull << 45);
+	IndexBuildTime build;
+	build.id = 7;
+	build.dims = 3;
+	build.cells = 42;
+	build.seconds = 0.5;
+	now.builds[1][0].time.add(500000000);
+	now.builds[1][0].last = build;
+
+	ostringstream out;
+	writePrometheus(out, now, &previous);
+	string text = out.str();
+	for(string line: {
+			"# TYPE minlink_query_seconds histogram",
+			"minlink_query_seconds_bucket{le=\"1.024e-06\"} 1",
+			"minlink_query_seconds_bucket{le=\"4.096e-06\"} 2",
+			"minlink_query_seconds_bucket{le=\"+Inf\"} 3",
+			"minlink_query_seconds_count 3",
+			"minlink_query_illumination_seconds_count 0",
+			"minlink_queries_total{path=\"short\"} 10",
+			"minlink_queries_total{path=\"illuminated\"} 6",
+			"minlink_fast_path_ratio 0.625",
+			"minlink_queries_per_second 8",
+			"minlink_cache_hit_ratio 0.25",
+			"# TYPE minlink_index_build_seconds histogram",
+			"minlink_index_build_seconds_bucket{dims=\"3\",kind=\"build\",le=\"0.536870912\"} 1",
+			"minlink_index_build_seconds_count{dims=\"3\",kind=\"build\"} 1",
+			"minlink_index_last_build_seconds{dims=\"3\",kind=\"build\"} 0.5",
+			"minlink_index_last_cells{dims=\"3\",kind=\"build\"} 42"}) {
+		EXPECT_NE(text.find(line + "\n"), string::npos) << line;
+	}
+	EXPECT_EQ(text.find("kind=\"update\""), string::npos);
+
+	ostringstream first;
+	writePrometheus(first, now, nullptr);
+	EXPECT_NE(first.str().find("minlink_queries_per_second 0\n"), string::npos);
+}
+
+TEST(MetricsTest, ExporterWritesFile) {
+	string path = "/tmp/metricsTest." + to_string(getpid()) + ".prom";
+	{
+		MetricsExporter exporter(path, chrono::milliseconds(10));
+		EXPECT_TRUE(exporter.write());
+		this_thread::sleep_for(chrono::milliseconds(30));
+	}
+	ifstream in(path);
+	ASSERT_TRUE(in);
+	stringstream text;
+	text << in.rdbuf();
+	EXPECT_NE(text.str().find("minlink_queries_total{path=\"trivial\"}"), string::npos);
+	EXPECT_FALSE(ifstream(path + ".tmp"));
+	remove(path.c_str());
+}
+
+} // namespace
@@ -0,0 +1,142 @@
+#include "minlink.h"
+
+#include "path.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+using namespace std;
+
+// Index of either dimension behind the C interface.
+struct minlink_index {
+	virtual ~minlink_index() {}
+	virtual int dims() const = 0;
+	// Returns MINLINK_OK or MINLINK_OUT_OF_MEMORY.
+	virtual int linkDistances(const int32_t* starts, const int32_t* ends, size_t count,
+			int maxLinks, int32_t* distances) = 0;
+};
+
+namespace {
+
+template<int D>
+Point<D> readPoint(const int32_t* coords, size_t i) {
+	Point<D> p;
+	for(int j=0; j<D; ++j) p[j] = coords[D*i + j];
+	return p;
+}
+
+template<int D>
+class DimIndex: public minlink_index {
+public:
+	explicit DimIndex(ObstacleSpan<D> obstacles): index(borrowLinkIndex(obstacles)) {}
+
+	int dims() const override { return D; }
+
+	// Splits the queries between a task per thread. Each task takes a
+	// workspace from the pool for the duration of the task, so concurrent
+	// batches only share the lock around the pool. The workspaces keep their
+	// buffers between the calls, so repeated batches do not allocate.
+	//
+	// An exception must not leave a task, as the pool would terminate, so a
+	// task running out of memory only records the failure. The other tasks
+	// then stop at their next query.
+	int linkDistances(const int32_t* starts, const int32_t* ends, size_t count,
+			int maxLinks, int32_t* distances) override {
+		LinkDistanceOptions options;
+		options.maxLinks = maxLinks;
+		int tasks = min((size_t)ThreadPool::global().size(), count);
+		atomic<bool> outOfMemory{false};
+		ThreadPool::global().run(tasks, [&](int task) {
+			try {
+				unique_ptr<QueryWorkspace<D>> workspace = takeWorkspace();
+				for(size_t i=task; i<count && !outOfMemory; i+=tasks) {
+					distances[i] = workspace->linkDistance(index, readPoint<D>(starts, i), readPoint<D>(ends, i), options);
+				}
+				lock_guard<mutex> lock(poolMutex);
+				pool.push_back(move(workspace));
+			} catch(const bad_alloc&) {
+				// The workspace may be left in the middle of a query, so it
+				// is freed instead of returned to the pool.
+				outOfMemory = true;
+			}
+		});
+		return outOfMemory ? MINLINK_OUT_OF_MEMORY : MINLINK_OK;
+	}
+
+private:
+	unique_ptr<QueryWorkspace<D>> takeWorkspace() {
+		lock_guard<mutex> lock(poolMutex);
+		if (pool.empty()) return unique_ptr<QueryWorkspace<D>>(new QueryWorkspace<D>());
+		unique_ptr<QueryWorkspace<D>> workspace = move(pool.back());
+		pool.pop_back();
+		return workspace;
+	}
+
+	BorrowedLinkIndex<D> index;
+	// Workspaces not used by any task.
+	vector<unique_ptr<QueryWorkspace<D>>> pool;
+	mutex poolMutex;
+};
+
+// Returns false if `obs` is not an obstacle face of direction in [0, 2*D).
+template<int D>
+bool validObstacle(const Obstacle<D>& obs) {
+	if (obs.direction < 0 || obs.direction >= 2*D) return false;
+	for(int i=0; i<D; ++i) {
+		if (obs.box[i].from > obs.box[i].to) return false;
+	}
+	return obs.box[obs.direction/2].empty();
+}
+
+// The records of `minlink_build_index` are used as obstacles in place.
+static_assert(sizeof(int) == sizeof(int32_t), "int is not 32 bits");
+static_assert(sizeof(Obstacle<2>) == 5*sizeof(int32_t) && sizeof(Obstacle<3>) == 7*sizeof(int32_t),
+		"Obstacle is not laid out as the records of minlink_build_index");
+static_assert(is_standard_layout<Obstacle<2>>::value && is_standard_layout<Obstacle<3>>::value,
+		"Obstacle is not laid out as the records of minlink_build_index");
+
+template<int D>
+int buildIndex(const int32_t* records, size_t count, minlink_index** index) {
+	const Obstacle<D>* obstacles = reinterpret_cast<const Obstacle<D>*>(records);
+	for(size_t i=0; i<count; ++i) {
+		if (!validObstacle(obstacles[i])) return MINLINK_INVALID_ARGUMENT;
+	}
+	*index = new DimIndex<D>(ObstacleSpan<D>(obstacles, obstacles + count));
+	return MINLINK_OK;
+}
+
+} // namespace
+
+int minlink_build_index(int dims, const int32_t* obstacles, size_t count, minlink_index** index) {
+	if (!index || (count && !obstacles)) return MINLINK_INVALID_ARGUMENT;
+	try {
+		if (dims == 2) return buildIndex<2>(obstacles, count, index);
+		if (dims == 3) return buildIndex<3>(obstacles, count, index);
+		return MINLINK_INVALID_ARGUMENT;
+	} catch(const bad_alloc&) {
+		return MINLINK_OUT_OF_MEMORY;
+	}
+}
+
+int minlink_link_distances(minlink_index* index, const int32_t* starts, const int32_t* ends, size_t count,
+		int32_t max_links, int32_t* distances) {
+	if (!index || (count && (!starts || !ends || !distances))) return MINLINK_INVALID_ARGUMENT;
+	try {
+		return index->linkDistances(starts, ends, count, max_links, distances);
+	} catch(const bad_alloc&) {
+		return MINLINK_OUT_OF_MEMORY;
+	}
+}
+
+int minlink_index_dims(const minlink_index* index) {
+	return index ? index->dims() : 0;
+}
+
+void minlink_free_index(minlink_index* index) {
+	delete index;
+}
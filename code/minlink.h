@@ -0,0 +1,58 @@
+#pragma once
+
+// C interface of minlink.so for callers that cannot use the C++ templates.
+//
+// Coordinates are 32-bit integers. A point is given by `dims` consecutive
+// coordinates, and a box by `2*dims` consecutive coordinates as the half-open
+// ranges (from, to) of each axis in order. Point p stands for the unit box
+// [p, p+1) as in the C++ interface.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Status codes returned by the functions.
+#define MINLINK_OK 0
+#define MINLINK_INVALID_ARGUMENT 1
+#define MINLINK_OUT_OF_MEMORY 2
+
+// Distances written by `minlink_link_distances` for unreachable end points
+// and for end points beyond the link budget.
+#define MINLINK_UNREACHABLE (-1)
+#define MINLINK_OVER_LINK_BUDGET (-2)
+
+// Free-space decomposition of an obstacle set, built once and queried many
+// times.
+typedef struct minlink_index minlink_index;
+
+// Builds an index of `count` obstacles in `dims` dimensions, where `dims` is
+// 2 or 3. Obstacle i takes the `2*dims+1` values from `obstacles[(2*dims+1)*i]`
+// on: a box, followed by its direction. The box is a face that is empty along
+// axis `direction/2`, with the free space on its lower side for even
+// directions and on its upper side for odd ones. The obstacles must enclose
+// the free space.
+//
+// The index refers to `obstacles` instead of copying them, so the array must
+// stay alive and unchanged until the index is freed by `minlink_free_index`.
+// Sets `*index` to the new index.
+int minlink_build_index(int dims, const int32_t* obstacles, size_t count, minlink_index** index);
+
+// Computes the link distances from `starts[i]` to `ends[i]` for the `count`
+// query pairs and writes them to `distances[i]`. The points are given by
+// `dims` coordinates each. Stops each query after `max_links` links, or runs
+// it to the end if `max_links` is negative. The queries are run in parallel.
+// Calls on the same index may be made from several threads at the same time.
+int minlink_link_distances(minlink_index* index, const int32_t* starts, const int32_t* ends, size_t count,
+		int32_t max_links, int32_t* distances);
+
+// Returns the number of dimensions of `index`, or 0 if `index` is null.
+int minlink_index_dims(const minlink_index* index);
+
+void minlink_free_index(minlink_index* index);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,163 @@
+#include "minlink.h"
+#include "obstacles.hpp"
+#include "path.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Allocations with the global operator new of at least this many bytes fail
+// while it is nonzero.
+std::atomic<std::size_t> failAllocationsFrom{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+	std::size_t limit = failAllocationsFrom;
+	if (limit && size >= limit) throw std::bad_alloc();
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+namespace {
+
+using namespace std;
+
+// Flattens `obstacles` into the records taken by `minlink_build_index`.
+template<int D>
+vector<int32_t> flatten(const ObstacleSet<D>& obstacles) {
+	vector<int32_t> records;
+	for(const Obstacle<D>& obs: obstacles) {
+		for(int i=0; i<D; ++i) {
+			records.push_back(obs.box[i].from);
+			records.push_back(obs.box[i].to);
+		}
+		records.push_back(obs.direction);
+	}
+	return records;
+}
+
+// Builds an index of `records`, which must outlive it.
+minlink_index* buildIndex(const vector<int32_t>& records) {
+	minlink_index* index = nullptr;
+	EXPECT_EQ(minlink_build_index(2, records.data(), records.size() / 5, &index), MINLINK_OK);
+	return index;
+}
+
+TEST(MinlinkCApi, SameAsLinkDistance) {
+	mt19937 rng(0);
+	vector<string> grid(16, string(16, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	vector<int32_t> records = flatten(obstacles);
+	minlink_index* index = buildIndex(records);
+	ASSERT_NE(index, nullptr);
+	EXPECT_EQ(minlink_index_dims(index), 2);
+
+	vector<int32_t> starts, ends;
+	vector<int> expected;
+	for(int i=0; i<100; ++i) {
+		Point<2> s, e;
+		for(int j=0; j<2; ++j) {
+			s[j] = rng()%16 + 1;
+			e[j] = rng()%16 + 1;
+		}
+		starts.insert(starts.end(), {s[0], s[1]});
+		ends.insert(ends.end(), {e[0], e[1]});
+		expected.push_back(linkDistance(obstacles, s, e));
+	}
+	vector<int32_t> distances(expected.size());
+	for(int round=0; round<2; ++round) {
+		EXPECT_EQ(minlink_link_distances(index, starts.data(), ends.data(), expected.size(), -1, distances.data()), MINLINK_OK);
+		EXPECT_EQ(vector<int>(distances.begin(), distances.end()), expected);
+	}
+
+	// Concurrent batches on the same index.
+	vector<thread> threads;
+	vector<vector<int32_t>> results(4, vector<int32_t>(expected.size()));
+	for(vector<int32_t>& res: results) {
+		threads.emplace_back([&] {
+			for(int round=0; round<3; ++round) {
+				EXPECT_EQ(minlink_link_distances(index, starts.data(), ends.data(), expected.size(), -1, res.data()), MINLINK_OK);
+			}
+		});
+	}
+	for(thread& t: threads) t.join();
+	for(const vector<int32_t>& res: results) {
+		EXPECT_EQ(vector<int>(res.begin(), res.end()), expected);
+	}
+	minlink_free_index(index);
+}
+
+TEST(MinlinkCApi, MaxLinks) {
+	vector<int32_t> records = flatten(makeObstaclesForPlane({"...", "##.", "..."}));
+	minlink_index* index = buildIndex(records);
+	int32_t starts[] = {1, 1, 1, 1};
+	int32_t ends[] = {1, 3, 3, 1};
+	int32_t distances[2];
+	EXPECT_EQ(minlink_link_distances(index, starts, ends, 2, 2, distances), MINLINK_OK);
+	EXPECT_EQ(distances[0], MINLINK_OVER_LINK_BUDGET);
+	EXPECT_EQ(distances[1], 1);
+	minlink_free_index(index);
+}
+
+TEST(MinlinkCApi, OutOfMemoryInQueries) {
+	mt19937 rng(0);
+	vector<string> grid(100, string(100, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+	vector<int32_t> records = flatten(obstacles);
+	minlink_index* index = buildIndex(records);
+	vector<int32_t> starts, ends;
+	for(int i=0; i<16; ++i) {
+		starts.insert(starts.end(), {(int32_t)(rng()%100 + 1), (int32_t)(rng()%100 + 1)});
+		ends.insert(ends.end(), {(int32_t)(rng()%100 + 1), (int32_t)(rng()%100 + 1)});
+	}
+	vector<int32_t> distances(starts.size() / 2);
+	// The query buffers of each task are sized by the index, unlike the
+	// allocations of the thread pool.
+	failAllocationsFrom = 1 << 14;
+	EXPECT_EQ(minlink_link_distances(index, starts.data(), ends.data(), distances.size(), -1, distances.data()),
+			MINLINK_OUT_OF_MEMORY);
+	failAllocationsFrom = 0;
+	EXPECT_EQ(minlink_link_distances(index, starts.data(), ends.data(), distances.size(), -1, distances.data()),
+			MINLINK_OK);
+	LinkIndex<2> expected = buildLinkIndex(obstacles);
+	for(size_t i=0; i<distances.size(); ++i) {
+		Point<2> s = {starts[2*i], starts[2*i+1]}, e = {ends[2*i], ends[2*i+1]};
+		EXPECT_EQ(distances[i], linkDistance(expected, s, e));
+	}
+	minlink_free_index(index);
+}
+
+TEST(MinlinkCApi, InvalidArguments) {
+	minlink_index* index = nullptr;
+	int32_t obstacle[] = {0, 1, 1, 1, 2};
+	EXPECT_EQ(minlink_build_index(4, obstacle, 1, &index), MINLINK_INVALID_ARGUMENT);
+	EXPECT_EQ(minlink_build_index(2, nullptr, 1, &index), MINLINK_INVALID_ARGUMENT);
+	obstacle[4] = 0;
+	EXPECT_EQ(minlink_build_index(2, obstacle, 1, &index), MINLINK_INVALID_ARGUMENT);
+	EXPECT_EQ(index, nullptr);
+	EXPECT_EQ(minlink_link_distances(nullptr, nullptr, nullptr, 0, -1, nullptr), MINLINK_INVALID_ARGUMENT);
+	EXPECT_EQ(minlink_index_dims(nullptr), 0);
+}
+
+} // namespace
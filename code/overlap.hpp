@@ -82,6 +82,45 @@ inline vector<pair<int,int>> overlappingBoxes(
 	return conns;
 }
 
+// Returns true if some box of `bs1` intersects some box of `bs2`. Unlike
+// `overlappingBoxes`, the boxes within each collection may overlap each other.
+//
+// Sweeps along the first axis, comparing each box to the boxes of the other
+// collection that are crossed by the sweep line. Time complexity
+// O(n*log n+k) where k is the number of pairs overlapping along the first
+// axis.
+template<int D>
+inline bool anyBoxesIntersect(
+		const vector<Box<D>>& bs1,
+		const vector<Box<D>>& bs2) {
+	const vector<Box<D>>* sets[2] = {&bs1, &bs2};
+	// Boxes of both sets as (set, index) in the order of their starts.
+	vector<pair<int,int>> order;
+	for(int s=0; s<2; ++s) {
+		for(int i=0; i<(int)sets[s]->size(); ++i) order.emplace_back(s, i);
+	}
+	auto box = [&](pair<int,int> p) -> const Box<D>& {
+		return (*sets[p.first])[p.second];
+	};
+	std::sort(order.begin(), order.end(), [&](pair<int,int> a, pair<int,int> b) {
+		return box(a)[0].from < box(b)[0].from;
+	});
+	vector<int> active[2];
+	for(pair<int,int> p: order) {
+		const Box<D>& b = box(p);
+		vector<int>& others = active[!p.first];
+		const vector<Box<D>>& otherBoxes = *sets[!p.first];
+		others.erase(std::remove_if(others.begin(), others.end(), [&](int j) {
+			return otherBoxes[j][0].to <= b[0].from;
+		}), others.end());
+		for(int j: others) {
+			if (b.intersects(otherBoxes[j])) return true;
+		}
+		active[p.first].push_back(p.second);
+	}
+	return false;
+}
+
 inline pair<int,int> makePair(int a, int b, bool swap) {
 	return swap ? make_pair(b, a) : make_pair(a,b);
 }
@@ -150,3 +189,39 @@ inline vector<pair<int,int>> overlappingBoxes(
 	}
 	return conns;
 }
+
+// Specialization for the 1-dimensional case, where the boxes are ranges.
+//
+// Sweeps over the starts of the ranges, pairing each range with the started
+// ranges of the other collection that have not ended yet. Time complexity
+// O(n*log n+k) where k is the number of intersections.
+template<>
+inline vector<pair<int,int>> overlappingBoxes(
+		const vector<Box<1>>& bs1,
+		const vector<Box<1>>& bs2) {
+	const vector<Box<1>>* sets[2] = {&bs1, &bs2};
+	vector<pair<int,int>> order;
+	for(int s=0; s<2; ++s) {
+		for(int i=0; i<(int)sets[s]->size(); ++i) order.emplace_back(s, i);
+	}
+	std::sort(order.begin(), order.end(), [&](pair<int,int> a, pair<int,int> b) {
+		return (*sets[a.first])[a.second][0].from < (*sets[b.first])[b.second][0].from;
+	});
+	vector<pair<int,int>> conns;
+	vector<int> active[2];
+	for(pair<int,int> p: order) {
+		Range r = (*sets[p.first])[p.second][0];
+		vector<int>& others = active[!p.first];
+		const vector<Box<1>>& otherBoxes = *sets[!p.first];
+		others.erase(std::remove_if(others.begin(), others.end(), [&](int j) {
+			return otherBoxes[j][0].to <= r.from;
+		}), others.end());
+		for(int j: others) {
+			if (r.intersects(otherBoxes[j][0])) {
+				conns.push_back(makePair(p.second, j, p.first));
+			}
+		}
+		active[p.first].push_back(p.second);
+	}
+	return conns;
+}
@@ -15,6 +15,14 @@ Box<3> box3(Range x, Range y, Range z) {
 	return {{x,y,z}};
 }
 
+TEST(OverlapTest1D, Simple) {
+	vector<Box<1>> bs1 = {{{Range{0,2}}}, {{Range{2,5}}}, {{Range{6,7}}}};
+	vector<Box<1>> bs2 = {{{Range{1,3}}}, {{Range{5,6}}}, {{Range{0,1}}}};
+	EXPECT_THAT(overlappingBoxes(bs1, bs2),
+			UnorderedElementsAre(
+				make_pair(0,0), make_pair(0,2), make_pair(1,0)));
+}
+
 TEST(OverlapTest2D, Simple) {
 	vector<Box<2>> bs1 = {
 		box2({0,2}, {0,1}),
@@ -55,4 +63,26 @@ TEST(OverlapTest3D, NoDuplicates) {
 				make_pair(2,0), make_pair(2,1), make_pair(2,2)));
 }
 
+TEST(AnyBoxesIntersect2D, Simple) {
+	vector<Box<2>> bs1 = {
+		box2({0,2}, {0,1}),
+		box2({0,3}, {2,3})};
+	EXPECT_FALSE(anyBoxesIntersect(bs1, {box2({2,3}, {0,2})}));
+	EXPECT_FALSE(anyBoxesIntersect(bs1, {}));
+	EXPECT_TRUE(anyBoxesIntersect(bs1, {box2({2,3}, {0,3})}));
+}
+
+TEST(AnyBoxesIntersect3D, OverlappingWithinSet) {
+	vector<Box<3>> bs1 = {
+		box3({0,4}, {0,1}, {0,1}),
+		box3({0,1}, {0,4}, {0,1})};
+	vector<Box<3>> bs2 = {
+		box3({0,1}, {0,1}, {1,4}),
+		box3({3,4}, {0,4}, {0,1})};
+	EXPECT_TRUE(anyBoxesIntersect(bs1, bs2));
+	bs1.pop_back();
+	bs2.pop_back();
+	EXPECT_FALSE(anyBoxesIntersect(bs1, bs2));
+}
+
 } // namespace
@@ -1,19 +1,28 @@
 #include "path.hpp"
 
+#include "BucketQueue.hpp"
+#include "boxUnion.hpp"
 #include "ClearableBitset.hpp"
+#include "CountTable.hpp"
+#include "LaneTree.hpp"
+#include "metrics.hpp"
+#include "overlap.hpp"
 #include "print.hpp"
+#include "ThreadPool.hpp"
 #include "UnifiedTree.hpp"
 #include "util.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <queue>
+#include <chrono>
 
 using namespace std;
 
 namespace {
 
-// Type of event in the sweep-plane algorithm.
+// Type of event in the sweep-plane algorithm. Events at the same position are
+// processed in the order of their types.
 enum class EventType {
 	// Add new illumination rectangle to the sweep plane state.
 	ADD_RECT,
@@ -22,177 +31,241 @@ enum class EventType {
 	// Remove illumination rectangle from the sweep plane state.
 	OBSTACLE
 };
-const string eventTypeNames[] = {"add", "cell", "obstacle"};
+constexpr int EVENT_TYPES = 3;
 
-// Event of the sweep-plane algorithm.
-template<int D>
-struct Event {
-	EventType type = EventType::ADD_RECT;
-	int cell = -1;
-	int position = -1;
-	Box<D-1> box;
+// Minimum number of sweep plane cells in a subtree for clearing its halves in
+// parallel on OBSTACLE events. Smaller subtrees are not worth the hand-off.
+constexpr long PARALLEL_REMOVE_CELLS = 1 << 14;
 
-	bool operator<(const Event& e) const {
-		if (position != e.position) return position < e.position;
-		return (int)type > (int)e.type;
-	}
-};
+// Number of sweep events between cancellation checks.
+constexpr int CANCEL_CHECK_INTERVAL = 1024;
 
+// Returns the coordinate where a sweep in direction `dir` leaves `box`.
 template<int D>
-ostream& operator<<(ostream& out, const Event<D>& e) {
-	return out<<"{"<<eventTypeNames[(int)e.type]<<' '<<e.cell<<' '<<e.position<<' '<<e.box<<"}";
+int sweepPosition(const Box<D>& box, int dir) {
+	return box[dir>>1][dir&1];
 }
 
-template<class T, class C>
-void removeEquals(vector<T>& v1, vector<T>& v2, C&& compare) {
-	sort(v1.begin(), v1.end(), compare);
-	sort(v2.begin(), v2.end(), compare);
-	auto it1=v1.begin(), it2=v2.begin();
-	auto k1=it1, k2=it2;
-	while(it1 != v1.end() && it2 != v2.end()) {
-		if (compare(*it1, *it2)) {
-			if (it1 != k1) iter_swap(k1, it1);
-			++k1,++it1;
-		} else if (compare(*it2, *it1)) {
-			if (it2 != k2) iter_swap(k2, it2);
-			++k2,++it2;
-		} else {
-			++it1,++it2;
-		}
+// ADD_RECT events of the sweep-plane algorithm. CELL and OBSTACLE events are
+// identified by the index of the cell or obstacle only, as their positions
+// can be read from the decomposition.
+//
+// Each field is kept in its own array, so the radix passes of
+// `mergeAdjacentEvents` read their keys from a single contiguous array.
+// With `LANES`, each event is limited to a set of query lanes, as used by
+// `multiLinkDistance`.
+template<int D, bool LANES>
+struct AddEvents {
+	// Coordinate of each event along the sweep axis.
+	vector<int> positions;
+	// Coordinate `j` of range `i` of the box of each event is in
+	// `coords[2*i+j]`.
+	vector<int> coords[2*(D-1)];
+	// Lanes of each event, only used with `LANES`.
+	vector<LaneMask> lanes;
+
+	size_t size() const { return positions.size(); }
+	bool empty() const { return positions.empty(); }
+	Box<D-1> box(size_t e) const {
+		Box<D-1> b;
+		for(int i=0; i<D-1; ++i) b[i] = {coords[2*i][e], coords[2*i+1][e]};
+		return b;
 	}
-	for(; it1 != v1.end(); ++it1, ++k1) if (it1 != k1) iter_swap(it1, k1);
-	for(; it2 != v2.end(); ++it2, ++k2) if (it2 != k2) iter_swap(it2, k2);
-	v1.erase(k1, v1.end());
-	v2.erase(k2, v2.end());
-}
 
-template<class T, class M>
-void mergeAdjacentElements(vector<T>& vec, M&& tryMerge) {
-	auto it = vec.begin(), keep=it;
-	for(; it != vec.end(); ++it, ++keep) {
-		auto n = next(it);
-		if (n==vec.end()) {
-			iter_swap(it++, keep++);
-			break;
-		}
-		if (tryMerge(*it, *n)) {
-			iter_swap(it, keep);
-			++it;
-		} else if (it != keep) {
-			iter_swap(it, keep);
+	// Adds the event of a sweep in direction `dir` leaving `box`.
+	void push(const Box<D>& box, int dir, LaneMask mask = 0) {
+		positions.push_back(sweepPosition(box, dir));
+		Box<D-1> b = box.project(dir>>1);
+		for(int i=0; i<D-1; ++i) {
+			coords[2*i].push_back(b[i].from);
+			coords[2*i+1].push_back(b[i].to);
 		}
+		if (LANES) lanes.push_back(mask);
+	}
+
+	// Calls `f` on each array in use.
+	template<class F>
+	void forEachColumn(F&& f) {
+		f(positions);
+		for(auto& c: coords) f(c);
+		if (LANES) f(lanes);
+	}
+	// Calls `f` on each array in use paired with the same array of `other`.
+	template<class F>
+	void forEachColumn(AddEvents& other, F&& f) {
+		f(positions, other.positions);
+		for(int i=0; i<2*(D-1); ++i) f(coords[i], other.coords[i]);
+		if (LANES) f(lanes, other.lanes);
 	}
-	vec.erase(keep, vec.end());
-}
+
+	void clear() {
+		forEachColumn([](auto& c) { c.clear(); });
+	}
+	// Moves all events of `other` to the end of this list.
+	void append(AddEvents& other) {
+		forEachColumn(other, [](auto& to, auto& from) { moveAppend(to, from); });
+	}
+	// Moves each event `e` to index `dest[e]`, using `scratch` as a buffer.
+	void permute(const vector<int>& dest, AddEvents& scratch) {
+		forEachColumn(scratch, [&](auto& c, auto& buffer) {
+			buffer.resize(c.size());
+			for(size_t e=0; e<c.size(); ++e) buffer[dest[e]] = c[e];
+			c.swap(buffer);
+		});
+	}
+};
 
 // Merge adjacent events along `axis`. For example two ADD_RECT events for
 // ranges [1,5] and [5,7] can be merged to a single event of range [1,7].
-template<int D>
-void mergeAdjacentEvents(vector<Event<D>>& events, int axis) {
-	sort(events.begin(), events.end(), [axis](const Event<D>& a, const Event<D>& b) {
-		if (a.position != b.position) return a.position < b.position;
+// Events of different query lanes are never merged.
+//
+// The events are first ordered lexicographically by position, the ranges of
+// the other axes, the lanes and finally the range of `axis`. The order is
+// computed by a least significant digit first radix sort where each
+// coordinate is a digit in [0, limit], and the lanes are ordered by a stable
+// sort of the event indices.
+template<int D, bool LANES>
+void mergeAdjacentEvents(AddEvents<D, LANES>& events, int axis, int limit, AddEvents<D, LANES>& scratch, vector<int>& counts, vector<int>& dest) {
+	size_t n = events.size();
+	dest.resize(n);
+	auto sortBy = [&](const vector<int>& keys) {
+		counts.assign(limit+2, 0);
+		for(int k: keys) ++counts[k+1];
+		for(int k=0; k<=limit; ++k) counts[k+1] += counts[k];
+		for(size_t e=0; e<n; ++e) dest[e] = counts[keys[e]]++;
+		events.permute(dest, scratch);
+	};
+	for(int j=1; j>=0; --j) sortBy(events.coords[2*axis+j]);
+	if (LANES) {
+		// `counts` is free between the counting passes.
+		vector<int>& order = counts;
+		order.resize(n);
+		for(size_t e=0; e<n; ++e) order[e] = e;
+		const vector<LaneMask>& lanes = events.lanes;
+		stable_sort(order.begin(), order.end(), [&](int a, int b) {
+			return lanes[a] < lanes[b];
+		});
+		for(size_t k=0; k<n; ++k) dest[order[k]] = k;
+		events.permute(dest, scratch);
+	}
+	for(int i=D-2; i>=0; --i) if (i != axis) {
+		for(int j=1; j>=0; --j) sortBy(events.coords[2*i+j]);
+	}
+	sortBy(events.positions);
+
+	auto mergeable = [&](size_t a, size_t b) {
+		if (events.positions[a] != events.positions[b]) return false;
+		if (LANES && events.lanes[a] != events.lanes[b]) return false;
 		for(int i=0; i<D-1; ++i) if (i != axis) {
-			for(int j=0; j<2; ++j) {
-				if (a.box[i][j] != b.box[i][j]) return a.box[i][j] < b.box[i][j];
-			}
+			if (events.coords[2*i][a] != events.coords[2*i][b]) return false;
+			if (events.coords[2*i+1][a] != events.coords[2*i+1][b]) return false;
 		}
-		for(int j=0; j<2; ++j) {
-			if (a.box[axis][j] != b.box[axis][j]) return a.box[axis][j] < b.box[axis][j];
+		return events.coords[2*axis+1][a] >= events.coords[2*axis][b];
+	};
+	vector<int>& to = events.coords[2*axis+1];
+	size_t kept = 0;
+	for(size_t e=0; e<n; ++e) {
+		if (kept && mergeable(kept-1, e)) {
+			to[kept-1] = max(to[kept-1], to[e]);
+			continue;
 		}
-		return false;
-	});
-	mergeAdjacentElements(events, [axis](Event<D>& a, Event<D>& b) {
-		if (a.position != b.position) return false;
-		for(int i=0; i<D-1; ++i) if (i != axis && a.box[i] != b.box[i]) return false;
-		if (a.box[axis].to < b.box[axis].from) return false;
-		a.box[axis].to = max(a.box[axis].to, b.box[axis].to);
-		return true;
-	});
+		events.forEachColumn([&](auto& c) { c[kept] = c[e]; });
+		++kept;
+	}
+	events.forEachColumn([&](auto& c) { c.resize(kept); });
 }
 
 // Stores sweep-plane events for sweeps in all directions.
+//
+// The events are stored by type: ADD_RECT events per direction, and CELL
+// events as a single list of cells, as every cell is swept in all directions.
 template<int D>
 struct EventSet {
-	vector<Event<D>> events[2*D];
+	AddEvents<D, false> events[2*D];
 	vector<int> cells;
 
+	// ADD_RECT events added by `addRects` that are not yet moved to `events`.
+	//
+	// The events along axis `a` are keyed by their box where the range of
+	// axis `a` is collapsed to the event position. The value is the net count
+	// of events in direction 2*a minus events in direction 2*a+1 for the key,
+	// so equal events in opposite directions cancel each other as they are
+	// added, and cancelled keys leave the table. The tables keep their
+	// capacity over rounds.
+	CountTable<Box<D>, int> pendingAdds[D];
+	// Scratch buffers for `filterAddEvents`.
+	AddEvents<D, false> scratch;
+	vector<int> counts, dest;
+
+	// Must not be called with unfiltered ADD_RECT events, as they may cancel
+	// each other out.
 	bool empty() const {
 		for(const auto& e: events) if (!e.empty()) return false;
-		return true;
+		for(const auto& m: pendingAdds) assert(m.empty());
+		return cells.empty();
 	}
 	void clear() {
 		for(auto& v: events) v.clear();
+		for(auto& m: pendingAdds) m.clear();
+		cells.clear();
 	}
-	void genCellEvents(const Decomposition<D>& dec);
-
-	// Performs "event filtering" which involves removing redundant ADD_RECT
-	// events and merging adjacent ones. We assume that `events` contains only
-	// ADD_RECT events when this is called.
-	void filterAddEvents() {
-		for(int a=0; a<D; ++a) {
-			removeEquals(events[2*a], events[2*a+1], [](const Event<D>& a, const Event<D>& b) {
-				int p1=abs(a.position), p2=abs(b.position);
-				if (p1!=p2) return p1<p2;
-				return a.box < b.box;
-			});
+	// Moves all events and cells of `other` to this set.
+	void append(EventSet& other) {
+		for(int i=0; i<2*D; ++i) {
+			events[i].append(other.events[i]);
 		}
 		for(int a=0; a<D; ++a) {
-			for(int m=0; m<D; ++m) if (a!=m) {
-				int axis = m - m>a;
-				mergeAdjacentEvents(events[2*a], axis);
-				mergeAdjacentEvents(events[2*a+1], axis);
+			for(const auto& p: other.pendingAdds[a].entries()) {
+				pendingAdds[a].update(p.first, [&](int& count) { count += p.second; });
 			}
+			other.pendingAdds[a].clear();
 		}
+		moveAppend(cells, other.cells);
+	}
+
+	// Adds ADD_RECT events in both directions of `axis` on the faces of
+	// `box`. Events cancelling each other are dropped immediately, and
+	// duplicate events are merged into one.
+	void addRects(const Box<D>& box, int axis) {
+		Box<D> key = box;
+		key[axis] = {box[axis].from, box[axis].from};
+		pendingAdds[axis].update(key, [](int& count) { ++count; });
+		key[axis] = {box[axis].to, box[axis].to};
+		pendingAdds[axis].update(key, [](int& count) { --count; });
+	}
+
+	// Removes duplicate CELL events.
+	void uniqueCells() {
+		sortUnique(cells);
 	}
+
+	// Performs "event filtering" which involves moving the ADD_RECT events
+	// that were not cancelled to `events` and merging adjacent ones. We assume
+	// that `events` contains only ADD_RECT events with coordinates in
+	// [0, limit] when this is called.
+	void filterAddEvents(int limit);
 };
 
 struct TreeItem {
 	int start = -1;
 };
 
-ostream& operator<<(ostream& out, const TreeItem& item) {
-	return out<<"("<<item.start<<")";
-}
-
-template<int D>
-Event<D> cellEvent(const Decomposition<D>& dec, int dir, int cell) {
-	Event<D> event;
-	event.type = EventType::CELL;
-	event.cell = cell;
-	event.position = dec[cell].box[dir>>1][dir&1];
-	if (dir&1) event.position *= -1;
-	return event;
-}
-
 template<int D>
-void EventSet<D>::genCellEvents(const Decomposition<D>& dec) {
-	sortUnique(cells);
-	for(int c: cells) {
-		for(int i=0; i<2*D; ++i) {
-			events[i].push_back(cellEvent(dec, i, c));
+void EventSet<D>::filterAddEvents(int limit) {
+	for(int a=0; a<D; ++a) {
+		for(const auto& p: pendingAdds[a].entries()) {
+			int dir = p.second > 0 ? 2*a : 2*a+1;
+			events[dir].push(p.first, dir);
+		}
+		pendingAdds[a].clear();
+	}
+	for(int a=0; a<D; ++a) {
+		for(int m=0; m<D; ++m) if (a!=m) {
+			int axis = m - m>a;
+			mergeAdjacentEvents(events[2*a], axis, limit, scratch, counts, dest);
+			mergeAdjacentEvents(events[2*a+1], axis, limit, scratch, counts, dest);
 		}
 	}
-	cells.clear();
-}
-
-template<int D>
-Event<D> obstacleEvent(const ObstacleSet<D>& obs, int dir, int obstacle) {
-	Event<D> event;
-	event.type = EventType::OBSTACLE;
-	event.cell = obstacle;
-	event.position = obs[obstacle].box[dir>>1][dir&1];
-	if (dir&1) event.position *= -1;
-	return event;
-}
-
-template<int D>
-Event<D> addRectEvent(const Box<D>& box, int dir) {
-	Event<D> event;
-	event.type = EventType::ADD_RECT;
-	event.position = box[dir>>1][dir&1];
-	if (dir&1) event.position *= -1;
-	event.box = box.project(dir>>1);
-	return event;
 }
 
 template<int D>
@@ -208,6 +281,84 @@ array<int, D-1> buildSize(const Decomposition<D>& dec) {
 	return arr;
 }
 
+// Box illuminated by a sweep, recorded for reconstructing paths. Each point
+// `p` of `box` is reached by a link along `axis` from `p` with the coordinate
+// of `axis` replaced by `source`.
+template<int D>
+struct LitBox {
+	Box<D> box;
+	int axis;
+	int source;
+};
+
+// Event queue of a sweep in a single direction.
+//
+// The queue is keyed by raw coordinates rather than by the rank of the
+// coordinate among the cell faces, as the start points of queries need not
+// lie on a face. It holds EVENT_TYPES*(coordinateLimit+1) buckets, which is
+// within a constant factor of the sweep plane over the same coordinates with
+// at least (2*coordinateLimit)^(D-1) nodes. A sweep scans the buckets only from its
+// first to its last event, so its time is the number of events plus the
+// extent of the events along the sweep axis.
+struct SweepQueue {
+	explicit SweepQueue(int coordinateLimit):
+		coordinateLimit(coordinateLimit),
+		queue(EVENT_TYPES*(coordinateLimit+1)) {}
+
+	// Returns the queue key of an event of type `type` at `position` in a
+	// sweep in direction `dir`. The keys grow in the sweep direction, and
+	// events at the same position are ordered ADD_RECT < CELL < OBSTACLE.
+	int eventKey(int dir, int position, EventType type) const {
+		int key = dir&1 ? position : coordinateLimit - position;
+		return EVENT_TYPES*key + (int)type;
+	}
+	// Inverse of `eventKey`.
+	int keyPosition(int dir, int key) const {
+		key /= EVENT_TYPES;
+		return dir&1 ? key : coordinateLimit - key;
+	}
+
+	// Upper bound for the coordinates in the decomposition.
+	int coordinateLimit;
+	// Queue of pending events keyed by `eventKey`. The items are indices of
+	// ADD_RECT events, cells or obstacles depending on the event type.
+	BucketQueue<int> queue;
+};
+
+// Per-direction state of a single sweep.
+//
+// Each sweep direction owns its own plane, visited sets and output buffers so
+// that all the sweeps of a round can run concurrently. The outputs are merged
+// into the shared state after the round.
+template<int D>
+struct DirectionSweep: SweepQueue {
+	typedef UnifiedTree<TreeItem, D-1> Plane;
+
+	DirectionSweep(const Decomposition<D>& dec, int obstacleCount):
+		SweepQueue(buildSize(dec)[0]),
+		plane(buildSize(dec)),
+		visitedCells(dec.size()),
+		visitedObstacles(obstacleCount) {}
+
+	Plane plane;
+	ClearableBitset visitedCells;
+	ClearableBitset visitedObstacles;
+
+	// Scratch buffers for bulk plane operations.
+	vector<Box<D-1>> bulkBoxes;
+	vector<int> bulkCells;
+
+	// Events generated for the next round.
+	EventSet<D> nextEvents;
+	// Obstacles reached for the first time during this round.
+	vector<int> reachedObstacles;
+	// Boxes illuminated during this round if paths are recorded.
+	vector<LitBox<D>> litBoxes;
+	// Indices of the targets found during this round.
+	vector<int> reachedTargets;
+	bool endFound = false;
+};
+
 // State of the staged illumination algorithm for min-link-path computation.
 //
 // Maintains `EventSet` for current and next steps. On each step, run
@@ -215,67 +366,185 @@ array<int, D-1> buildSize(const Decomposition<D>& dec) {
 // next step in the process.
 template<int D>
 struct IlluminateState {
-	typedef UnifiedTree<TreeItem, D-1> Plane;
+	typedef typename DirectionSweep<D>::Plane Plane;
 	using Index = typename Plane::Index;
 
-	IlluminateState(ObstacleSet<D> obs):
-		obstacles(obs), decomposition(decomposeFreeSpace(obstacles)),
-	plane(buildSize(decomposition)),
-	obstacleReachTime(obstacles.size(), -1),
-	visitedCells(decomposition.size()),
-	visitedObstacles(obstacles.size()) {}
+	IlluminateState(ObstacleSpan<D> obstacles, const Decomposition<D>& decomposition):
+		obstacles(obstacles), decomposition(decomposition),
+	obstacleReachTime(obstacles.size(), -1) {
+		for(int i=0; i<2*D; ++i) {
+			sweeps.emplace_back(decomposition, obstacles.size());
+		}
+	}
+
+	// Runs the sweeps of all directions in parallel and merges their results.
+	void runRound() {
+		ThreadPool::global().run(2*D, [this](int dir) {
+			sweep(dir);
+		});
+		for(DirectionSweep<D>& s: sweeps) {
+			nextEvents.append(s.nextEvents);
+			for(int obs: s.reachedObstacles) {
+				if (obstacleReachTime[obs] < 0) {
+					obstacleReachTime[obs] = curStep;
+					reachedObstacles.push_back(obs);
+				}
+			}
+			s.reachedObstacles.clear();
+			endFound |= s.endFound;
+			for(int t: s.reachedTargets) {
+				if (targetRound[t] < 0) {
+					targetRound[t] = curStep;
+					++targetsFound;
+				}
+			}
+			s.reachedTargets.clear();
+		}
+		if (recordPath) {
+			litBoxes.emplace_back();
+			for(DirectionSweep<D>& s: sweeps) {
+				moveAppend(litBoxes.back(), s.litBoxes);
+			}
+		}
+	}
+
+	// Returns the vertices of a minimum-link path from the start point to
+	// `endP` by following the recorded boxes backwards from `endP`. The end
+	// point must have been found with `recordPath` set.
+	vector<Point<D>> tracePath() const {
+		vector<Point<D>> path = {endP};
+		Point<D> p = endP;
+		for(auto round = litBoxes.rbegin(); round != litBoxes.rend(); ++round) {
+			auto it = find_if(round->begin(), round->end(), [&](const LitBox<D>& b) {
+				return b.box.contains(p);
+			});
+			assert(it != round->end());
+			p[it->axis] = it->source;
+			path.push_back(p);
+		}
+		reverse(path.begin(), path.end());
+		return path;
+	}
+
+	// Prepares the state for another illumination, keeping the allocated
+	// buffers. The sweep planes are empty after each completed round, so
+	// only the state of the query needs to be cleared. Must not be called
+	// after a cancelled round.
+	void reset() {
+		hasEnd = false;
+		endFound = false;
+		for(DirectionSweep<D>& s: sweeps) s.endFound = false;
+		targets.clear();
+		targetRound.clear();
+		targetsFound = 0;
+		recordPath = false;
+		cancel = nullptr;
+		litBoxes.clear();
+		curEvents.clear();
+		nextEvents.clear();
+		for(int obs: reachedObstacles) obstacleReachTime[obs] = -1;
+		reachedObstacles.clear();
+		curStep = 0;
+	}
 
 	void newRound() {
 		++curStep;
 		swap(curEvents, nextEvents);
 		nextEvents.clear();
-		curEvents.filterAddEvents();
-		curEvents.genCellEvents(decomposition);
+		curEvents.filterAddEvents(sweeps[0].coordinateLimit);
+		curEvents.uniqueCells();
 	}
 
+	// Sweeps the plane in direction `dir`. Only reads the shared state, and
+	// writes only to `sweeps[dir]`.
 	void sweep(int dir) {
-		cout<<"    sweep "<<dir<<'\n';
-		visitedCells.reset();
-		visitedObstacles.reset();
+		DirectionSweep<D>& s = sweeps[dir];
+		Plane& plane = s.plane;
+		s.visitedCells.reset();
+		s.visitedObstacles.reset();
 		const int axis = dir/2;
-		priority_queue<Event<D>> events(curEvents.events[dir].begin(), curEvents.events[dir].end());
-		while(!events.empty()) {
-			Event<D> event = events.top();
-			cout<<"event "<<event<<'\n';
-			events.pop();
-			int position = dir&1 ? -event.position : event.position;
-
-			if (event.type == EventType::ADD_RECT) {
-				plane.add(event.box, {position});
-				cout<<"add box "<<event.box<<'\n';
-			} else if (event.type == EventType::CELL) {
-				const Cell<D>& cell = decomposition[event.cell];
-				if (!plane.check(cell.box.project(axis))) {
-					continue;
-				}
-				nextEvents.cells.push_back(event.cell);
-				for(int obs: cell.obstacles[dir]) {
-					if (visitedObstacles[obs]) continue;
-					visitedObstacles.set(obs);
-					events.push(obstacleEvent(obstacles, dir, obs));
+		BucketQueue<int>& events = s.queue;
+		auto push = [&](EventType type, int position, int id) {
+			events.push(s.eventKey(dir, position, type), id);
+		};
+		auto pushCell = [&](int cell) {
+			push(EventType::CELL, sweepPosition(decomposition[cell].box, dir), cell);
+		};
+		events.rewind();
+		const AddEvents<D, false>& adds = curEvents.events[dir];
+		for(size_t i=0; i<adds.size(); ++i) {
+			push(EventType::ADD_RECT, adds.positions[i], i);
+		}
+		for(int cell: curEvents.cells) {
+			pushCell(cell);
+		}
+		for(int steps=0; !events.empty(); ++steps) {
+			if (cancel && steps % CANCEL_CHECK_INTERVAL == 0 && cancel->stopRequested()) {
+				// The state is abandoned after cancellation, so the
+				// remaining events are left in the queue.
+				return;
+			}
+			int key = events.topKey();
+			EventType type = EventType(key % EVENT_TYPES);
+			int position = s.keyPosition(dir, key);
+			int id = events.pop();
+
+			if (type == EventType::ADD_RECT) {
+				// Add all the rectangles at the same position at once.
+				s.bulkBoxes.assign(1, adds.box(id));
+				while(!events.empty() && events.topKey() == key
+						&& (int)s.bulkBoxes.size() < Plane::MAX_BULK) {
+					s.bulkBoxes.push_back(adds.box(events.pop()));
 				}
-				for(int nb: cell.links[dir]) {
-					Box<D-1> box = decomposition[nb].box.project(axis);
-					if (plane.check(box) && !visitedCells[nb]) {
-						visitedCells.set(nb);
-						events.push(cellEvent(decomposition, dir, nb));
+				plane.add(s.bulkBoxes, {position});
+			} else if (type == EventType::CELL) {
+				const Cell<D>& cell = decomposition[id];
+				const vector<int>& links = cell.links[dir];
+				// Check the cell and its unvisited neighbors in batches. The
+				// first batch starts with the cell itself.
+				bool first = true;
+				size_t next = 0;
+				do {
+					s.bulkBoxes.clear();
+					s.bulkCells.clear();
+					if (first) {
+						s.bulkBoxes.push_back(cell.box.project(axis));
 					}
-				}
+					for(; next < links.size() && (int)s.bulkBoxes.size() < Plane::MAX_BULK; ++next) {
+						int nb = links[next];
+						if (s.visitedCells[nb]) continue;
+						s.bulkBoxes.push_back(decomposition[nb].box.project(axis));
+						s.bulkCells.push_back(nb);
+					}
+					auto lit = plane.check(s.bulkBoxes);
+					if (first) {
+						if (!(lit & 1)) break;
+						lit >>= 1;
+						first = false;
+						s.nextEvents.cells.push_back(id);
+						for(int obs: cell.obstacles[dir]) {
+							if (s.visitedObstacles[obs]) continue;
+							s.visitedObstacles.set(obs);
+							push(EventType::OBSTACLE, sweepPosition(obstacles[obs].box, dir), obs);
+						}
+					}
+					for(size_t i=0; i<s.bulkCells.size(); ++i) {
+						if (lit>>i & 1) {
+							s.visitedCells.set(s.bulkCells[i]);
+							pushCell(s.bulkCells[i]);
+						}
+					}
+				} while(next < links.size());
 			} else {
-				int& time = obstacleReachTime[event.cell];
+				int time = obstacleReachTime[id];
 				if (time<0) {
 					time = curStep;
+					s.reachedObstacles.push_back(id);
 				}
-				Box<D-1> box = obstacles[event.cell].box.project(dir/2);
-				cout<<"remove box "<<box<<'\n';
-				plane.remove(box, [&](Index idx, const TreeItem& item) {
-					onRemove(axis, idx, item, position, time);
-				});
+				Box<D-1> box = obstacles[id].box.project(dir/2);
+				plane.removeParallel(box, [&](Index idx, const TreeItem& item) {
+					onRemove(s, axis, idx, item, position, time);
+				}, ThreadPool::global(), PARALLEL_REMOVE_CELLS);
 			}
 		}
 	}
@@ -283,55 +552,492 @@ struct IlluminateState {
 	// Runs when we remove free space from the sweep plane on OBSTACLE event.
 	// At this point we generate new ADD_RECT events for the next step on the
 	// boundaries of the removed free space cell.
-	void onRemove(int axis, Index index, const TreeItem& item, int position, int obsTime) {
+	void onRemove(DirectionSweep<D>& s, int axis, Index index, const TreeItem& item, int position, int obsTime) {
 		Range range = item.start<position ? Range{item.start, position} : Range{position, item.start};
-		cout<<"Remove "<<axis<<' '<<index<<' '<<item<<' '<<position<<'\n';
 		if (item.start == position) return;
 		Box<D> box;
 		for(int i=0; i<D; ++i) {
-			box[i] = i<axis ? plane.rangeForIndex(i, index[i])
+			box[i] = i<axis ? s.plane.rangeForIndex(i, index[i])
 				: i==axis ? range
-				: plane.rangeForIndex(i-1, index[i-1]);
+				: s.plane.rangeForIndex(i-1, index[i-1]);
 		}
-		cout<<"rm box "<<box<<'\n';
-		if (box.contains(endP)) {
-			endFound = true;
+		if (hasEnd && box.contains(endP)) {
+			s.endFound = true;
+		}
+		if (!targets.empty()) findTargets(box, s.reachedTargets);
+		if (recordPath) {
+			// The free space was lit from the cell next to `item.start` on
+			// the side of the sweep origin.
+			int source = item.start < position ? item.start - 1 : item.start;
+			s.litBoxes.push_back({box, axis, source});
 		}
 		if (curStep > obsTime + D + 1) {
 			return;
 		}
-		for(int i=0; i<2*D; ++i) {
-			if (i/2 != axis) {
-				nextEvents.events[i].push_back(addRectEvent(box, i));
+		for(int a=0; a<D; ++a) {
+			if (a != axis) {
+				s.nextEvents.addRects(box, a);
 			}
 		}
 	}
 
-	const ObstacleSet<D> obstacles;
-	const Decomposition<D> decomposition;
+	// Adds to `found` the indices of the unreached targets inside `box`.
+	void findTargets(const Box<D>& box, vector<int>& found) const {
+		auto it = lower_bound(targets.begin(), targets.end(), box[0].from, [](const Point<D>& p, int x) {
+			return p[0] < x;
+		});
+		for(; it != targets.end() && (*it)[0] < box[0].to; ++it) {
+			int t = it - targets.begin();
+			if (targetRound[t] < 0 && box.contains(*it)) found.push_back(t);
+		}
+	}
+
+	ObstacleSpan<D> obstacles;
+	const Decomposition<D>& decomposition;
 	Point<D> endP;
+	// Whether `endP` is set. Without it the illumination only stops when
+	// the caller stops running rounds or all the reachable space is lit.
+	bool hasEnd = false;
 	bool endFound = false;
+	// End points checked in addition to `endP`, sorted by the first
+	// coordinate.
+	vector<Point<D>> targets;
+	// Round where each of `targets` was first lit, or -1.
+	vector<int> targetRound;
+	int targetsFound = 0;
+	// Whether to keep the boxes lit on each round for `tracePath`. The
+	// records take memory proportional to the illuminated boxes.
+	bool recordPath = false;
+	// Checked periodically during the sweeps. A cancelled sweep stops
+	// early, leaving the state unusable.
+	const CancelToken* cancel = nullptr;
+	vector<vector<LitBox<D>>> litBoxes;
 
 	EventSet<D> curEvents;
 	EventSet<D> nextEvents;
 
+	vector<DirectionSweep<D>> sweeps;
+	vector<int> obstacleReachTime;
+	// Obstacles whose `obstacleReachTime` is set.
+	vector<int> reachedObstacles;
+
+	int curStep = 0;
+};
+
+// Signed counter per query lane, stored bit-sliced: bit i of `bits[j]` is the
+// j'th bit of the two's complement counter of lane i.
+struct LaneCounter {
+	static constexpr int BITS = 16;
+
+	// Adds 1 to the counters of `lanes`, or -1 if `negative`.
+	void add(LaneMask lanes, bool negative) {
+		addBits([&](int j) { return j==0 || negative ? lanes : 0; });
+	}
+	void add(const LaneCounter& other) {
+		addBits([&](int j) { return other.bits[j]; });
+	}
+
+	bool zero() const {
+		return !nonzero();
+	}
+	bool operator==(const LaneCounter& other) const {
+		return equal(begin(bits), end(bits), begin(other.bits));
+	}
+	LaneMask nonzero() const {
+		LaneMask res = 0;
+		for(LaneMask b: bits) res |= b;
+		return res;
+	}
+	LaneMask negative() const {
+		return bits[BITS-1];
+	}
+	LaneMask positive() const {
+		return nonzero() & ~negative();
+	}
+
+	LaneMask bits[BITS] = {};
+
+private:
+	// Ripple-carry addition of the counter with bits `other(j)`.
+	template<class F>
+	void addBits(F&& other) {
+		LaneMask carry = 0;
+		for(int j=0; j<BITS; ++j) {
+			LaneMask a = bits[j], b = other(j);
+			bits[j] = a ^ b ^ carry;
+			carry = (a & b) | (carry & (a ^ b));
+		}
+	}
+};
+
+// Lane mask per element that can be reset in time proportional to the number
+// of changed elements.
+class ClearableLaneMasks {
+public:
+	explicit ClearableLaneMasks(int size): masks(size) {}
+
+	LaneMask operator[](int i) const { return masks[i]; }
+	// Adds `lanes` to element `i` and returns its previous mask.
+	LaneMask add(int i, LaneMask lanes) {
+		LaneMask old = masks[i];
+		if (!old) touched.push_back(i);
+		masks[i] |= lanes;
+		return old;
+	}
+	// Clears element `i` and returns its previous mask.
+	LaneMask take(int i) {
+		LaneMask old = masks[i];
+		masks[i] = 0;
+		return old;
+	}
+	void reset() {
+		for(int i: touched) masks[i] = 0;
+		touched.clear();
+	}
+
+private:
+	vector<LaneMask> masks;
+	vector<int> touched;
+};
+
+// Same as `EventSet`, but each event carries the mask of query lanes it
+// belongs to.
+template<int D>
+struct LaneEventSet {
+	AddEvents<D, true> events[2*D];
+	// CELL events with the lanes reaching each cell.
+	vector<pair<int, LaneMask>> cells;
+	// Same as `EventSet::pendingAdds`, with a net count per lane.
+	CountTable<Box<D>, LaneCounter> pendingAdds[D];
+	// Scratch buffers for `filterAddEvents`.
+	AddEvents<D, true> scratch;
+	vector<int> counts, dest;
+
+	// Same as `EventSet::empty`.
+	bool empty() const {
+		for(const auto& e: events) if (!e.empty()) return false;
+		for(const auto& m: pendingAdds) assert(m.empty());
+		return cells.empty();
+	}
+	void clear() {
+		for(auto& v: events) v.clear();
+		for(auto& m: pendingAdds) m.clear();
+		cells.clear();
+	}
+	void append(LaneEventSet& other) {
+		for(int i=0; i<2*D; ++i) {
+			events[i].append(other.events[i]);
+		}
+		for(int a=0; a<D; ++a) {
+			for(const auto& p: other.pendingAdds[a].entries()) {
+				pendingAdds[a].update(p.first, [&](LaneCounter& count) { count.add(p.second); });
+			}
+			other.pendingAdds[a].clear();
+		}
+		moveAppend(cells, other.cells);
+	}
+
+	void addRects(const Box<D>& box, int axis, LaneMask lanes) {
+		Box<D> key = box;
+		key[axis] = {box[axis].from, box[axis].from};
+		pendingAdds[axis].update(key, [&](LaneCounter& count) { count.add(lanes, false); });
+		key[axis] = {box[axis].to, box[axis].to};
+		pendingAdds[axis].update(key, [&](LaneCounter& count) { count.add(lanes, true); });
+	}
+
+	// Removes duplicate CELL events by merging their lanes, and drops the
+	// lanes not in `active`.
+	void uniqueCells(LaneMask active) {
+		sort(cells.begin(), cells.end());
+		auto out = cells.begin();
+		for(auto it = cells.begin(); it != cells.end(); ) {
+			int cell = it->first;
+			LaneMask lanes = 0;
+			for(; it != cells.end() && it->first == cell; ++it) lanes |= it->second;
+			lanes &= active;
+			if (lanes) *out++ = {cell, lanes};
+		}
+		cells.erase(out, cells.end());
+	}
+
+	// Same as `EventSet::filterAddEvents`, dropping the lanes not in
+	// `active`.
+	void filterAddEvents(int limit, LaneMask active) {
+		for(int a=0; a<D; ++a) {
+			for(const auto& p: pendingAdds[a].entries()) {
+				LaneMask lanes[2] = {p.second.positive() & active, p.second.negative() & active};
+				for(int k=0; k<2; ++k) {
+					if (!lanes[k]) continue;
+					events[2*a+k].push(p.first, 2*a+k, lanes[k]);
+				}
+			}
+			pendingAdds[a].clear();
+		}
+		for(int a=0; a<D; ++a) {
+			for(int m=0; m<D; ++m) if (a!=m) {
+				int axis = m - m>a;
+				mergeAdjacentEvents(events[2*a], axis, limit, scratch, counts, dest);
+				mergeAdjacentEvents(events[2*a+1], axis, limit, scratch, counts, dest);
+			}
+		}
+	}
+};
+
+// Per-direction state of a multi-query sweep. Same as `DirectionSweep` with
+// the visited sets and outputs tracked per lane.
+template<int D>
+struct LaneDirectionSweep: SweepQueue {
+	typedef LaneTree<TreeItem, D-1> Plane;
+
+	LaneDirectionSweep(const Decomposition<D>& dec, int obstacleCount):
+		SweepQueue(buildSize(dec)[0]),
+		plane(buildSize(dec)),
+		visitedCells(dec.size()),
+		visitedObstacles(obstacleCount),
+		pendingCells(dec.size()),
+		pendingObstacles(obstacleCount) {}
+
 	Plane plane;
+	ClearableLaneMasks visitedCells;
+	ClearableLaneMasks visitedObstacles;
+	// Lanes of the queued CELL and OBSTACLE events. Each cell and obstacle
+	// is queued once for all the lanes reaching it.
+	ClearableLaneMasks pendingCells;
+	ClearableLaneMasks pendingObstacles;
 
-	vector<int> obstacleReachTime;
-	ClearableBitset visitedCells;
-	ClearableBitset visitedObstacles;
+	LaneEventSet<D> nextEvents;
+	// Obstacles reached for the first time during this round by some lanes.
+	vector<pair<int, LaneMask>> reachedObstacles;
+	LaneMask endFound = 0;
+};
+
+// Bit-sliced version of `IlluminateState` running the illumination for up to
+// LANES queries at the same time. Each lane behaves exactly as a separate
+// `IlluminateState`, but the lanes share the event queues and plane
+// traversals.
+template<int D>
+struct LaneIlluminateState {
+	typedef typename LaneDirectionSweep<D>::Plane Plane;
+	using Index = typename Plane::Index;
+
+	LaneIlluminateState(ObstacleSpan<D> obstacles, const Decomposition<D>& decomposition):
+		obstacles(obstacles), decomposition(decomposition),
+		obstacleReached(obstacles.size()), obstacleExpired(obstacles.size()) {
+		for(int i=0; i<2*D; ++i) {
+			sweeps.emplace_back(decomposition, obstacles.size());
+		}
+	}
+
+	void runRound() {
+		ThreadPool::global().run(2*D, [this](int dir) {
+			sweep(dir);
+		});
+		reachHistory.emplace_back();
+		for(LaneDirectionSweep<D>& s: sweeps) {
+			nextEvents.append(s.nextEvents);
+			for(const auto& p: s.reachedObstacles) {
+				LaneMask fresh = p.second & ~obstacleReached[p.first];
+				if (!fresh) continue;
+				obstacleReached[p.first] |= fresh;
+				reachHistory.back().emplace_back(p.first, fresh);
+			}
+			s.reachedObstacles.clear();
+			endFound |= s.endFound;
+			s.endFound = 0;
+		}
+	}
+
+	// Starts the next round. Lanes that found the end point are given their
+	// distance and dropped.
+	void newRound() {
+		++curStep;
+		forEachLane(endFound & active, [&](int lane) {
+			distance[lane] = curStep;
+		});
+		active &= ~endFound;
+		// Lanes reaching an obstacle at round t stop generating events from
+		// it after round t+D+1, same as in `IlluminateState::onRemove`.
+		int expiring = curStep - D - 2;
+		if (expiring >= 0) {
+			for(const auto& p: reachHistory[expiring]) {
+				obstacleExpired[p.first] |= p.second;
+			}
+		}
+		swap(curEvents, nextEvents);
+		nextEvents.clear();
+		curEvents.filterAddEvents(sweeps[0].coordinateLimit, active);
+		curEvents.uniqueCells(active);
+	}
+
+	void sweep(int dir) {
+		LaneDirectionSweep<D>& s = sweeps[dir];
+		Plane& plane = s.plane;
+		s.visitedCells.reset();
+		s.visitedObstacles.reset();
+		s.pendingCells.reset();
+		s.pendingObstacles.reset();
+		const int axis = dir/2;
+		BucketQueue<int>& events = s.queue;
+		auto push = [&](EventType type, int position, int id) {
+			events.push(s.eventKey(dir, position, type), id);
+		};
+		auto pushCell = [&](int cell, LaneMask lanes) {
+			if (!s.pendingCells.add(cell, lanes)) {
+				push(EventType::CELL, sweepPosition(decomposition[cell].box, dir), cell);
+			}
+		};
+		events.rewind();
+		const AddEvents<D, true>& adds = curEvents.events[dir];
+		for(size_t i=0; i<adds.size(); ++i) {
+			push(EventType::ADD_RECT, adds.positions[i], i);
+		}
+		for(const auto& c: curEvents.cells) {
+			pushCell(c.first, c.second);
+		}
+		while(!events.empty()) {
+			int key = events.topKey();
+			EventType type = EventType(key % EVENT_TYPES);
+			int position = s.keyPosition(dir, key);
+			int id = events.pop();
+
+			if (type == EventType::ADD_RECT) {
+				plane.add(adds.box(id), adds.lanes[id], {position});
+			} else if (type == EventType::CELL) {
+				const Cell<D>& cell = decomposition[id];
+				LaneMask lit = plane.check(cell.box.project(axis), s.pendingCells.take(id));
+				if (!lit) continue;
+				s.nextEvents.cells.emplace_back(id, lit);
+				for(int obs: cell.obstacles[dir]) {
+					LaneMask fresh = lit & ~s.visitedObstacles[obs];
+					if (!fresh) continue;
+					s.visitedObstacles.add(obs, fresh);
+					if (!s.pendingObstacles.add(obs, fresh)) {
+						push(EventType::OBSTACLE, sweepPosition(obstacles[obs].box, dir), obs);
+					}
+				}
+				for(int nb: cell.links[dir]) {
+					LaneMask lanes = plane.check(decomposition[nb].box.project(axis), lit & ~s.visitedCells[nb]);
+					if (!lanes) continue;
+					s.visitedCells.add(nb, lanes);
+					pushCell(nb, lanes);
+				}
+			} else {
+				LaneMask lanes = s.pendingObstacles.take(id);
+				LaneMask fresh = lanes & ~obstacleReached[id];
+				if (fresh) {
+					s.reachedObstacles.emplace_back(id, fresh);
+				}
+				LaneMask live = ~obstacleExpired[id];
+				Box<D-1> box = obstacles[id].box.project(dir/2);
+				plane.remove(box, lanes, [&](Index idx, LaneMask cleared, const typename Plane::Values& values) {
+					onRemove(s, axis, idx, cleared, values, position, live);
+				});
+			}
+		}
+	}
+
+	// Same as `IlluminateState::onRemove` for each lane of `cleared`. Lanes
+	// with equal starting points share the removed box, and events are
+	// generated only for the lanes in `live`.
+	void onRemove(LaneDirectionSweep<D>& s, int axis, Index index, LaneMask cleared,
+			const typename Plane::Values& values, int position, LaneMask live) {
+		while(cleared) {
+			int start = values[__builtin_ctzll(cleared)].start;
+			LaneMask group = 0;
+			forEachLane(cleared, [&](int lane) {
+				if (values[lane].start == start) group |= LaneMask(1) << lane;
+			});
+			cleared &= ~group;
+			if (start == position) continue;
+			Range range = start<position ? Range{start, position} : Range{position, start};
+			Box<D> box;
+			for(int i=0; i<D; ++i) {
+				box[i] = i<axis ? s.plane.rangeForIndex(i, index[i])
+					: i==axis ? range
+					: s.plane.rangeForIndex(i-1, index[i-1]);
+			}
+			forEachLane(group, [&](int lane) {
+				if (box.contains(endPoints[lane])) s.endFound |= LaneMask(1) << lane;
+			});
+			group &= live;
+			if (!group) continue;
+			for(int a=0; a<D; ++a) {
+				if (a != axis) {
+					s.nextEvents.addRects(box, a, group);
+				}
+			}
+		}
+	}
+
+	ObstacleSpan<D> obstacles;
+	const Decomposition<D>& decomposition;
+	Point<D> endPoints[LANES];
+	// Lanes still searching for their end point.
+	LaneMask active = 0;
+	LaneMask endFound = 0;
+	int distance[LANES];
+
+	LaneEventSet<D> curEvents;
+	LaneEventSet<D> nextEvents;
+
+	vector<LaneDirectionSweep<D>> sweeps;
+	// Lanes that have reached each obstacle, and the lanes for which the
+	// obstacle no longer generates events.
+	vector<LaneMask> obstacleReached;
+	vector<LaneMask> obstacleExpired;
+	// Obstacles reached for the first time by some lanes on each round.
+	vector<vector<pair<int, LaneMask>>> reachHistory;
 
 	int curStep = 0;
 };
 
+// Walks the axis-parallel segment from `from` to `to` through the cells of
+// `dec`, starting from `cell` that contains `from`. Returns the cell
+// containing `to`, or -1 if the segment is blocked.
 template<int D>
-int pointCell(const Decomposition<D>& dec, Point<D> pt) {
-	int i=0;
-	while(!dec[i].box.contains(pt)) {
-		++i;
-		assert(i < (int)dec.size());
+int walkSegment(const Decomposition<D>& dec, int cell, Point<D> from, Point<D> to) {
+	int axis = 0;
+	for(int i=0; i<D; ++i) {
+		if (from[i] != to[i]) axis = i;
 	}
-	return i;
+	int dir = 2*axis + (to[axis] > from[axis]);
+	Point<D> p = from;
+	while(!dec[cell].box.contains(to)) {
+		Range r = dec[cell].box[axis];
+		p[axis] = dir&1 ? r.to : r.from-1;
+		int next = -1;
+		for(int j: dec[cell].links[dir]) {
+			if (dec[j].box.contains(p)) {
+				next = j;
+				break;
+			}
+		}
+		if (next < 0) return -1;
+		cell = next;
+	}
+	return cell;
+}
+
+// Returns the link distance from `startP` in `startCell` to `endP` if it is
+// at most two, or -1 if it is more. Checks the direct segment and the L-shaped
+// paths by walking the cells along them.
+template<int D>
+int shortLinkDistance(const Decomposition<D>& dec, int startCell, Point<D> startP, Point<D> endP) {
+	int axes[2], diff = 0;
+	for(int i=0; i<D; ++i) {
+		if (startP[i] == endP[i]) continue;
+		if (diff == 2) return -1;
+		axes[diff++] = i;
+	}
+	if (diff == 0) return 0;
+	if (diff == 1) return walkSegment(dec, startCell, startP, endP) >= 0 ? 1 : -1;
+	for(int axis: axes) {
+		Point<D> corner = startP;
+		corner[axis] = endP[axis];
+		int cell = walkSegment(dec, startCell, startP, corner);
+		if (cell >= 0 && walkSegment(dec, cell, corner, endP) >= 0) return 2;
+	}
+	return -1;
 }
 
 template<int D>
@@ -341,34 +1047,605 @@ Box<D> unitBox(Point<D> pt) {
 	return box;
 }
 
-} // namespace
+// Returns the boxes of `region` that meet the bounds of the nonempty set
+// `boxes`.
+template<int D>
+vector<Box<D>> boxesNear(const vector<Box<D>>& region, const vector<Box<D>>& boxes) {
+	Box<D> bounds = boxes[0];
+	for(const Box<D>& b: boxes) {
+		for(int i=0; i<D; ++i) bounds[i] = bounds[i].union_(b[i]);
+	}
+	vector<Box<D>> near;
+	for(const Box<D>& b: region) {
+		if (b.intersects(bounds)) near.push_back(b);
+	}
+	return near;
+}
 
+// Adds the parts of `added` not yet in `region` to the end of it, where both
+// are sets of disjoint boxes. Only the boxes of `region` near `added` are
+// compared, so the cost grows with the added boxes rather than with the union
+// of the whole region.
 template<int D>
-int linkDistance(const ObstacleSet<D>& obstacles, Point<D> startP, Point<D> endP) {
-	IlluminateState<D> state(obstacles);
-	state.endP = endP;
-	const auto& decomposition = state.decomposition;
-	cout<<"decomposition: "<<decomposition<<' '<<startP<<'\n';
-	int startCell = pointCell(decomposition, startP);
+void addToRegion(vector<Box<D>>& region, const vector<Box<D>>& added) {
+	if (added.empty()) return;
+	vector<Box<D>> near = boxesNear(region, added);
+	vector<vector<Box<D>>> covers(added.size());
+	for(pair<int,int> p: overlappingBoxes(added, near)) covers[p.first].push_back(near[p.second]);
+	for(size_t i=0; i<added.size(); ++i) {
+		for(const Box<D>& b: boxDifference(added[i], covers[i])) region.push_back(b);
+	}
+}
+
+// Adds the events for the first round of illumination from `startP` in
+// `startCell`.
+template<int D>
+void seedIllumination(IlluminateState<D>& state, Point<D> startP, int startCell) {
 	Box<D> startBox = unitBox(startP);
-	if (startBox.contains(endP)) return 0;
 	state.curEvents.cells.push_back(startCell);
 	for(int i=0; i<2*D; ++i) {
-		auto& events = state.curEvents.events[i];
-		events.push_back(addRectEvent(startBox, i));
+		state.curEvents.events[i].push(startBox, i);
 	}
-	state.curEvents.genCellEvents(decomposition);
+	state.curEvents.uniqueCells();
+}
+
+// Returns true if another round may be run after `rounds` rounds without
+// exceeding `maxLinks`, where negative `maxLinks` means no limit.
+bool roundAllowed(int rounds, int maxLinks) {
+	return maxLinks < 0 || rounds < maxLinks;
+}
+
+// Runs the illumination from `startP` in `startCell` until `state.endP` is found, all the
+// reachable space is illuminated, `maxLinks` rounds have been run or
+// `state.cancel` is cancelled. Returns the link distance, -1,
+// OVER_LINK_BUDGET or CANCELLED. Counts the completed rounds in
+// `progress.roundsCompleted`.
+template<int D>
+int illuminate(IlluminateState<D>& state, Point<D> startP, int startCell, int maxLinks, QueryProgress& progress) {
+	if (state.hasEnd && unitBox(startP).contains(state.endP)) return 0;
+	seedIllumination(state, startP, startCell);
 	while(!state.curEvents.empty() && !state.endFound) {
-		cout<<"\nround "<<state.curStep<<'\n';
-		for(int i=0; i<2*D; ++i) {
-			state.sweep(i);
-		}
+		if (!roundAllowed(state.curStep, maxLinks)) return OVER_LINK_BUDGET;
+		if (state.cancel && state.cancel->stopRequested()) return CANCELLED;
+		state.runRound();
+		if (state.cancel && state.cancel->stopRequested()) return CANCELLED;
 		state.newRound();
+		++progress.roundsCompleted;
 	}
 	return state.endFound ? state.curStep : -1;
 }
 
+// Illuminates from both `startP` in `startCell` and `endP` in `endCell`,
+// alternating the rounds between the two sides, until a box lit from one side
+// intersects the region lit from the other side. Returns the link distance,
+// -1, OVER_LINK_BUDGET if the sides do not meet within `maxLinks` rounds in
+// total or CANCELLED if `cancel` is cancelled.
+//
+// After a and b rounds the sides have lit the points reachable with at most
+// a and b links respectively. Every vertex of a minimum-link path of d links
+// is reachable from the sides with k and d-k links for some k, so the regions
+// first meet when a+b = d. The lit boxes are recorded for the intersection
+// checks only.
+//
+// Each side keeps its lit region as a set of disjoint boxes. The regions are
+// disjoint until the sides meet, so only the part of a round's boxes that is
+// new to its own side can meet the other side, and only that part is checked
+// against the boxes of the other region near it.
+template<int D>
+int illuminateBidirectional(ObstacleSpan<D> obstacles, const Decomposition<D>& decomposition,
+		Point<D> startP, Point<D> endP, int startCell, int endCell, int maxLinks, const CancelToken* cancel,
+		QueryProgress& progress) {
+	if (unitBox(startP).contains(endP)) return 0;
+	IlluminateState<D> forward(obstacles, decomposition), backward(obstacles, decomposition);
+	IlluminateState<D>* states[2] = {&forward, &backward};
+	Point<D> points[2] = {startP, endP};
+	int cells[2] = {startCell, endCell};
+	vector<Box<D>> lit[2];
+	for(int side=0; side<2; ++side) {
+		IlluminateState<D>& state = *states[side];
+		state.endP = points[!side];
+		state.hasEnd = true;
+		state.recordPath = true;
+		state.cancel = cancel;
+		seedIllumination(state, points[side], cells[side]);
+		lit[side].push_back(unitBox(points[side]));
+	}
+	for(int side=0; ; side = !side) {
+		IlluminateState<D>& state = *states[side];
+		// One side has lit all the space reachable from it without meeting
+		// the other side.
+		if (state.curEvents.empty()) return -1;
+		if (!roundAllowed(forward.curStep + backward.curStep, maxLinks)) {
+			return OVER_LINK_BUDGET;
+		}
+		if (cancel && cancel->stopRequested()) return CANCELLED;
+		state.runRound();
+		if (cancel && cancel->stopRequested()) return CANCELLED;
+		state.newRound();
+		++progress.roundsCompleted;
+		vector<Box<D>> boxes;
+		for(const LitBox<D>& b: state.litBoxes.back()) boxes.push_back(b.box);
+		state.litBoxes.clear();
+		size_t oldSize = lit[side].size();
+		addToRegion(lit[side], boxUnion(boxes));
+		vector<Box<D>> added(lit[side].begin() + oldSize, lit[side].end());
+		if (!added.empty() && anyBoxesIntersect(added, boxesNear(lit[!side], added))) {
+			return forward.curStep + backward.curStep;
+		}
+	}
+}
+
+// Runs the illumination from `sources` until `k` of `targets` are reached or
+// all the reachable space is illuminated, and returns the reached targets by
+// distance as in `nearestTargets`. The points are located through `grid`.
+template<int D>
+vector<TargetDistance> illuminateTargets(ObstacleSpan<D> obstacles, const Decomposition<D>& decomposition,
+		const CellGrid<D>& grid, const vector<int>& components, const vector<Point<D>>& sources,
+		const vector<Point<D>>& targets, int k) {
+	vector<TargetDistance> res;
+	vector<int> sourceComponents;
+	vector<Point<D>> seeds;
+	vector<int> seedCells;
+	for(Point<D> p: sources) {
+		int cell = grid.cellContaining(decomposition, p);
+		if (cell < 0) continue;
+		sourceComponents.push_back(components[cell]);
+		seeds.push_back(p);
+		seedCells.push_back(cell);
+	}
+	sortUnique(sourceComponents);
+	// Targets that may be reached, sorted by the first coordinate.
+	vector<int> order;
+	for(int i=0; i<(int)targets.size(); ++i) {
+		int cell = grid.cellContaining(decomposition, targets[i]);
+		if (cell < 0) continue;
+		if (!binary_search(sourceComponents.begin(), sourceComponents.end(), components[cell])) continue;
+		if (find(seeds.begin(), seeds.end(), targets[i]) != seeds.end()) {
+			res.push_back({i, 0});
+		} else {
+			order.push_back(i);
+		}
+	}
+	if ((int)res.size() >= k || order.empty()) {
+		res.resize(min<size_t>(res.size(), max(k, 0)));
+		return res;
+	}
+	sort(order.begin(), order.end(), [&](int a, int b) {
+		return targets[a][0] < targets[b][0];
+	});
+
+	IlluminateState<D> state(obstacles, decomposition);
+	for(int i: order) state.targets.push_back(targets[i]);
+	state.targetRound.assign(order.size(), -1);
+	for(size_t i=0; i<seeds.size(); ++i) seedIllumination(state, seeds[i], seedCells[i]);
+	while(!state.curEvents.empty() && (int)res.size() + state.targetsFound < k) {
+		state.runRound();
+		state.newRound();
+	}
+	for(size_t i=0; i<order.size(); ++i) {
+		if (state.targetRound[i] >= 0) res.push_back({order[i], state.targetRound[i] + 1});
+	}
+	sort(res.begin(), res.end(), [](const TargetDistance& a, const TargetDistance& b) {
+		return a.distance != b.distance ? a.distance < b.distance : a.target < b.target;
+	});
+	res.resize(min<size_t>(res.size(), k));
+	return res;
+}
+
+using Clock = chrono::steady_clock;
+
+uint64_t nanosBetween(Clock::time_point from, Clock::time_point to) {
+	return chrono::duration_cast<chrono::nanoseconds>(to - from).count();
+}
+
+// Answers a `linkDistance` query from the cells of the points if it has a fast
+// path. Sets `path` to how it was answered, or to ILLUMINATED if the query
+// needs illumination, in which case the cells of the points found through
+// `grid` are returned in `startCell` and `endCell`.
+template<int D>
+int fastLinkDistance(const Decomposition<D>& decomposition, const CellGrid<D>& grid, const vector<int>& components,
+		Point<D> startP, Point<D> endP, const LinkDistanceOptions& options, QueryPath& path,
+		int& startCell, int& endCell) {
+	path = QueryPath::TRIVIAL;
+	if (unitBox(startP).contains(endP)) return 0;
+	path = QueryPath::UNREACHABLE;
+	startCell = grid.cellContaining(decomposition, startP);
+	endCell = grid.cellContaining(decomposition, endP);
+	if (startCell < 0 || endCell < 0 || components[startCell] != components[endCell]) return -1;
+	path = QueryPath::SHORT;
+	int shortDist = shortLinkDistance(decomposition, startCell, startP, endP);
+	if (shortDist >= 0) {
+		if (options.maxLinks >= 0 && shortDist > options.maxLinks) return OVER_LINK_BUDGET;
+		return shortDist;
+	}
+	path = QueryPath::ILLUMINATED;
+	return -1;
+}
+
+// Runs a `linkDistance` query on the given decomposition and records it in
+// `LinkMetrics::global()`. Illuminates with `reused` if it is given, or with
+// a new state otherwise. The reused state must be built for `obstacles` and
+// `decomposition`, and must be reset.
+template<int D>
+int decomposedLinkDistance(ObstacleSpan<D> obstacles, const Decomposition<D>& decomposition,
+		const CellGrid<D>& grid, const vector<int>& components, Point<D> startP, Point<D> endP,
+		const LinkDistanceOptions& options, QueryProgress& progress, IlluminateState<D>* reused = nullptr) {
+	Clock::time_point begin = Clock::now();
+	QueryPath path;
+	int startCell, endCell;
+	int dist = fastLinkDistance(decomposition, grid, components, startP, endP, options, path, startCell, endCell);
+	Clock::time_point looked = Clock::now();
+	if (path != QueryPath::ILLUMINATED) {
+		LinkMetrics::global().recordQuery(path, nanosBetween(begin, looked), 0);
+		return dist;
+	}
+	if (options.bidirectional) {
+		dist = illuminateBidirectional(obstacles, decomposition, startP, endP, startCell, endCell,
+				options.maxLinks, options.cancel, progress);
+	} else {
+		auto run = [&](IlluminateState<D>& state) {
+			state.endP = endP;
+			state.hasEnd = true;
+			state.cancel = options.cancel;
+			return illuminate(state, startP, startCell, options.maxLinks, progress);
+		};
+		if (reused) {
+			dist = run(*reused);
+		} else {
+			IlluminateState<D> state(obstacles, decomposition);
+			dist = run(state);
+		}
+	}
+	LinkMetrics::global().recordQuery(path, nanosBetween(begin, looked), nanosBetween(looked, Clock::now()));
+	return dist;
+}
+
+} // namespace
+
+template<int D>
+int linkDistance(ObstacleSpan<D> obstacles, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	QueryProgress localProgress;
+	QueryProgress& progress = options.progress ? *options.progress : localProgress;
+	progress = QueryProgress();
+	Decomposition<D> decomposition;
+	if (options.cancel) {
+		if (!tryDecomposeFreeSpace(obstacles, *options.cancel, decomposition)) return CANCELLED;
+	} else {
+		decomposition = decomposeFreeSpace(obstacles);
+	}
+	progress.decomposed = true;
+	return decomposedLinkDistance(obstacles, decomposition, CellGrid<D>(decomposition),
+			connectedComponents(decomposition), startP, endP, options, progress);
+}
+
+namespace {
+
+// Source of `LinkIndex::id` values.
+atomic<unsigned long> nextIndexId{1};
+
+// Records the build or update of `index` that started at `begin`.
+template<int D, class Index>
+void recordBuild(const Index& index, bool update, Clock::time_point begin) {
+	IndexBuildTime build;
+	build.id = index.id;
+	build.dims = D;
+	build.cells = index.decomposition.size();
+	build.update = update;
+	build.seconds = chrono::duration<double>(Clock::now() - begin).count();
+	LinkMetrics::global().recordIndexBuild(build);
+}
+
+} // namespace
+
+template<int D>
+LinkIndex<D> buildLinkIndex(ObstacleSet<D> obstacles) {
+	Clock::time_point begin = Clock::now();
+	LinkIndex<D> index;
+	index.id = nextIndexId++;
+	index.decomposition = decomposeFreeSpace(obstacles);
+	index.cellGrid = CellGrid<D>(index.decomposition);
+	index.obstacles = move(obstacles);
+	index.components = connectedComponents(index.decomposition);
+	for(int c: index.components) index.componentLabels = max(index.componentLabels, c+1);
+	recordBuild<D>(index, false, begin);
+	return index;
+}
+
+template<int D>
+BorrowedLinkIndex<D> borrowLinkIndex(ObstacleSpan<D> obstacles) {
+	Clock::time_point begin = Clock::now();
+	BorrowedLinkIndex<D> index(obstacles);
+	index.id = nextIndexId++;
+	index.decomposition = decomposeFreeSpace(obstacles);
+	index.cellGrid = CellGrid<D>(index.decomposition);
+	index.components = connectedComponents(index.decomposition);
+	recordBuild<D>(index, false, begin);
+	return index;
+}
+
+template<int D>
+vector<int> updateLinkIndex(LinkIndex<D>& index, const vector<int>& removed, const ObstacleSet<D>& added) {
+	Clock::time_point begin = Clock::now();
+	vector<int> repaired;
+	vector<int> addedIndex = updateDecomposition(index.obstacles, index.decomposition, index.cellGrid,
+			removed, added, index.components, repaired);
+	updateComponents(index.decomposition, repaired, index.components, index.componentLabels);
+	index.id = nextIndexId++;
+	recordBuild<D>(index, true, begin);
+	return addedIndex;
+}
+
+namespace {
+
+// Runs a `linkDistance` query on a `LinkIndex` or a `BorrowedLinkIndex`.
+template<int D, class Index>
+int indexLinkDistance(const Index& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	QueryProgress localProgress;
+	QueryProgress& progress = options.progress ? *options.progress : localProgress;
+	progress = QueryProgress();
+	progress.decomposed = true;
+	return decomposedLinkDistance<D>(index.obstacles, index.decomposition, index.cellGrid, index.components,
+			startP, endP, options, progress);
+}
+
+} // namespace
+
+template<int D>
+int linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	return indexLinkDistance(index, startP, endP, options);
+}
+
+template<int D>
+int linkDistance(const BorrowedLinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	return indexLinkDistance(index, startP, endP, options);
+}
+
+template<int D>
+vector<TargetDistance> nearestTargets(ObstacleSpan<D> obstacles, const vector<Point<D>>& sources,
+		const vector<Point<D>>& targets, int k) {
+	Decomposition<D> decomposition = decomposeFreeSpace(obstacles);
+	return illuminateTargets(obstacles, decomposition, CellGrid<D>(decomposition),
+			connectedComponents(decomposition), sources, targets, k);
+}
+
+template<int D>
+vector<TargetDistance> nearestTargets(const LinkIndex<D>& index, const vector<Point<D>>& sources,
+		const vector<Point<D>>& targets, int k) {
+	return illuminateTargets<D>(index.obstacles, index.decomposition, index.cellGrid, index.components,
+			sources, targets, k);
+}
+
+template<int D>
+size_t LinkDistanceCache<D>::KeyHash::operator()(const Key& k) const {
+	// The coordinates are widened before multiplying, so that large ones wrap
+	// around in size_t instead of overflowing int.
+	size_t res = k.index;
+	for(int i=0; i<D; ++i) res = 33331*res + 65537*(size_t)k.start[i];
+	for(int i=0; i<D; ++i) res = 33331*res + 65537*(size_t)k.end[i];
+	return res;
+}
+
+template<int D>
+int LinkDistanceCache<D>::linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	Key key{index.id, startP, endP};
+	int dist;
+	bool hit = cache.get(key, dist);
+	LinkMetrics::global().recordCacheLookup(hit);
+	if (hit) {
+		if (options.progress) *options.progress = QueryProgress{true, 0};
+		if (options.maxLinks >= 0 && dist > options.maxLinks) return OVER_LINK_BUDGET;
+		return dist;
+	}
+	dist = ::linkDistance(index, startP, endP, options);
+	if (dist != OVER_LINK_BUDGET && dist != CANCELLED) cache.put(key, dist);
+	return dist;
+}
+
+template<int D>
+struct QueryWorkspace<D>::Buffers {
+	template<class Index>
+	explicit Buffers(const Index& index):
+		indexId(index.id), decomposition(&index.decomposition),
+		state(index.obstacles, index.decomposition) {}
+
+	// Identify the index that `state` refers to. The id alone does not
+	// tell if the index has been moved.
+	unsigned long indexId;
+	const Decomposition<D>* decomposition;
+	IlluminateState<D> state;
+};
+
+template<int D>
+QueryWorkspace<D>::QueryWorkspace() {}
+template<int D>
+QueryWorkspace<D>::~QueryWorkspace() {}
+template<int D>
+QueryWorkspace<D>::QueryWorkspace(QueryWorkspace&&) = default;
+template<int D>
+QueryWorkspace<D>& QueryWorkspace<D>::operator=(QueryWorkspace&&) = default;
+
+template<int D>
+int QueryWorkspace<D>::linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	return query(index, startP, endP, options);
+}
+
+template<int D>
+int QueryWorkspace<D>::linkDistance(const BorrowedLinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	return query(index, startP, endP, options);
+}
+
+template<int D>
+template<class Index>
+int QueryWorkspace<D>::query(const Index& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options) {
+	if (options.bidirectional) return indexLinkDistance(index, startP, endP, options);
+	if (!buffers || buffers->indexId != index.id || buffers->decomposition != &index.decomposition) {
+		buffers.reset(new Buffers(index));
+	}
+	QueryProgress localProgress;
+	QueryProgress& progress = options.progress ? *options.progress : localProgress;
+	progress = QueryProgress();
+	progress.decomposed = true;
+	int dist = decomposedLinkDistance<D>(index.obstacles, index.decomposition, index.cellGrid, index.components,
+			startP, endP, options, progress, &buffers->state);
+	if (dist == CANCELLED) {
+		buffers.reset();
+	} else {
+		buffers->state.reset();
+	}
+	return dist;
+}
+
+template<int D>
+void QueryWorkspace<D>::clear() {
+	buffers.reset();
+}
+
+template<int D>
+vector<Point<D>> minLinkPath(ObstacleSpan<D> obstacles, Point<D> startP, Point<D> endP) {
+	Decomposition<D> decomposition = decomposeFreeSpace(obstacles);
+	CellGrid<D> grid(decomposition);
+	int startCell = grid.cellContaining(decomposition, startP);
+	int endCell = grid.cellContaining(decomposition, endP);
+	if (startCell < 0 || endCell < 0) return {};
+	vector<int> components = connectedComponents(decomposition);
+	if (components[startCell] != components[endCell]) return {};
+	IlluminateState<D> state(obstacles, decomposition);
+	state.endP = endP;
+	state.hasEnd = true;
+	state.recordPath = true;
+	QueryProgress progress;
+	int dist = illuminate(state, startP, startCell, -1, progress);
+	if (dist < 0) return {};
+	if (dist == 0) return {startP};
+	vector<Point<D>> path = state.tracePath();
+	assert(path.front() == startP);
+	return path;
+}
+
+template<int D>
+vector<vector<Box<D>>> linkIsochrones(ObstacleSpan<D> obstacles, Point<D> startP, int maxLinks) {
+	Decomposition<D> decomposition = decomposeFreeSpace(obstacles);
+	int startCell = CellGrid<D>(decomposition).cellContaining(decomposition, startP);
+	if (startCell < 0) return {};
+	IlluminateState<D> state(obstacles, decomposition);
+	// Without an end point the illumination runs until `maxLinks` rounds
+	// or all the reachable space is lit.
+	state.recordPath = true;
+	seedIllumination(state, startP, startCell);
+	vector<vector<Box<D>>> res = {{unitBox(startP)}};
+	while((int)res.size() <= maxLinks) {
+		if (state.curEvents.empty()) {
+			res.push_back(res.back());
+			continue;
+		}
+		state.runRound();
+		state.newRound();
+		vector<Box<D>> boxes;
+		for(const LitBox<D>& b: state.litBoxes.back()) boxes.push_back(b.box);
+		state.litBoxes.clear();
+		res.push_back(res.back());
+		addToRegion(res.back(), boxUnion(boxes));
+	}
+	return res;
+}
+
+template<int D>
+vector<int> multiLinkDistance(ObstacleSpan<D> obstacles, const vector<Point<D>>& startPoints, const vector<Point<D>>& endPoints) {
+	assert(startPoints.size() == endPoints.size());
+	Decomposition<D> decomposition = decomposeFreeSpace(obstacles);
+	CellGrid<D> grid(decomposition);
+	vector<int> components = connectedComponents(decomposition);
+	vector<int> res(startPoints.size(), -1);
+	for(size_t first=0; first<startPoints.size(); first+=LANES) {
+		int lanes = min<size_t>(LANES, startPoints.size() - first);
+		LaneIlluminateState<D> state(obstacles, decomposition);
+		for(int l=0; l<lanes; ++l) {
+			Point<D> startP = startPoints[first+l];
+			Box<D> startBox = unitBox(startP);
+			state.endPoints[l] = endPoints[first+l];
+			state.distance[l] = -1;
+			if (startBox.contains(endPoints[first+l])) {
+				state.distance[l] = 0;
+				continue;
+			}
+			int startCell = grid.cellContaining(decomposition, startP);
+			int endCell = grid.cellContaining(decomposition, endPoints[first+l]);
+			if (startCell < 0 || endCell < 0 || components[startCell] != components[endCell]) continue;
+			int shortDist = shortLinkDistance(decomposition, startCell, startP, endPoints[first+l]);
+			if (shortDist >= 0) {
+				state.distance[l] = shortDist;
+				continue;
+			}
+			LaneMask lane = LaneMask(1) << l;
+			state.active |= lane;
+			state.curEvents.cells.emplace_back(startCell, lane);
+			for(int i=0; i<2*D; ++i) {
+				state.curEvents.events[i].push(startBox, i, lane);
+			}
+		}
+		state.curEvents.uniqueCells(state.active);
+		while(!state.curEvents.empty()) {
+			state.runRound();
+			state.newRound();
+		}
+		copy(state.distance, state.distance + lanes, res.begin() + first);
+	}
+	return res;
+}
+
+template
+LinkIndex<2> buildLinkIndex<2>(ObstacleSet<2> obstacles);
+template
+LinkIndex<3> buildLinkIndex<3>(ObstacleSet<3> obstacles);
+template
+BorrowedLinkIndex<2> borrowLinkIndex<2>(ObstacleSpan<2> obstacles);
+template
+BorrowedLinkIndex<3> borrowLinkIndex<3>(ObstacleSpan<3> obstacles);
+template
+vector<TargetDistance> nearestTargets<2>(ObstacleSpan<2> obstacles, const vector<Point<2>>& sources,
+		const vector<Point<2>>& targets, int k);
+template
+vector<TargetDistance> nearestTargets<3>(ObstacleSpan<3> obstacles, const vector<Point<3>>& sources,
+		const vector<Point<3>>& targets, int k);
+template
+vector<TargetDistance> nearestTargets<2>(const LinkIndex<2>& index, const vector<Point<2>>& sources,
+		const vector<Point<2>>& targets, int k);
+template
+vector<TargetDistance> nearestTargets<3>(const LinkIndex<3>& index, const vector<Point<3>>& sources,
+		const vector<Point<3>>& targets, int k);
+template
+class LinkDistanceCache<2>;
+template
+class LinkDistanceCache<3>;
+template
+class QueryWorkspace<2>;
+template
+class QueryWorkspace<3>;
+template
+vector<int> updateLinkIndex<2>(LinkIndex<2>& index, const vector<int>& removed, const ObstacleSet<2>& added);
+template
+vector<int> updateLinkIndex<3>(LinkIndex<3>& index, const vector<int>& removed, const ObstacleSet<3>& added);
+template
+int linkDistance<2>(const LinkIndex<2>& index, Point<2> startP, Point<2> endP, const LinkDistanceOptions& options);
+template
+int linkDistance<2>(const BorrowedLinkIndex<2>& index, Point<2> startP, Point<2> endP, const LinkDistanceOptions& options);
+template
+int linkDistance<3>(const BorrowedLinkIndex<3>& index, Point<3> startP, Point<3> endP, const LinkDistanceOptions& options);
+template
+int linkDistance<3>(const LinkIndex<3>& index, Point<3> startP, Point<3> endP, const LinkDistanceOptions& options);
+template
+int linkDistance<2>(ObstacleSpan<2> obstacles, Point<2> startP, Point<2> endP, const LinkDistanceOptions& options);
+template
+int linkDistance<3>(ObstacleSpan<3> obstacles, Point<3> startP, Point<3> endP, const LinkDistanceOptions& options);
+template
+vector<Point<2>> minLinkPath<2>(ObstacleSpan<2> obstacles, Point<2> startP, Point<2> endP);
+template
+vector<Point<3>> minLinkPath<3>(ObstacleSpan<3> obstacles, Point<3> startP, Point<3> endP);
+template
+vector<vector<Box<2>>> linkIsochrones<2>(ObstacleSpan<2> obstacles, Point<2> startP, int maxLinks);
+template
+vector<vector<Box<3>>> linkIsochrones<3>(ObstacleSpan<3> obstacles, Point<3> startP, int maxLinks);
 template
-int linkDistance<2>(const ObstacleSet<2>& obstacles, Point<2> startP, Point<2> endP);
+vector<int> multiLinkDistance<2>(ObstacleSpan<2> obstacles, const vector<Point<2>>& startPoints, const vector<Point<2>>& endPoints);
 template
-int linkDistance<3>(const ObstacleSet<3>& obstacles, Point<3> startP, Point<3> endP);
+vector<int> multiLinkDistance<3>(ObstacleSpan<3> obstacles, const vector<Point<3>>& startPoints, const vector<Point<3>>& endPoints);
@@ -1,8 +1,236 @@
 #pragma once
 #include "Box.hpp"
 #include "decomposition.hpp"
+#include "LruCache.hpp"
+
+#include <memory>
+#include <vector>
+
+// Returned by `linkDistance` when the end point is not reachable within
+// `LinkDistanceOptions::maxLinks` links.
+constexpr int OVER_LINK_BUDGET = -2;
+// Returned by `linkDistance` when the query was cancelled through
+// `LinkDistanceOptions::cancel`.
+constexpr int CANCELLED = -3;
+
+// Progress of a `linkDistance` query. Tells how far a cancelled query got.
+struct QueryProgress {
+	// Whether the free-space decomposition was completed.
+	bool decomposed = false;
+	// Number of completed illumination rounds. In bidirectional mode, the
+	// total of both sides.
+	int roundsCompleted = 0;
+};
+
+// Options for `linkDistance`.
+struct LinkDistanceOptions {
+	// Illuminate from both end points, alternating the rounds, until the
+	// illuminated regions meet. Typically halves the number of rounds per side
+	// and shrinks the illuminated volume on long corridor-like domains.
+	bool bidirectional = false;
+	// Stop after this many links and return OVER_LINK_BUDGET if the end
+	// point was not reached yet. Negative for no limit.
+	int maxLinks = -1;
+	// If set, checked between the depths of the decomposition and between
+	// the rounds and periodically during the sweeps of the illumination.
+	// The query returns CANCELLED once cancellation is requested.
+	const CancelToken* cancel = nullptr;
+	// If set, updated as the query proceeds.
+	QueryProgress* progress = nullptr;
+};
 
 // Computes the minimum-link path between `startP` and `endP` and returns the
-// link distance.
+// link distance, or -1 if `endP` is unreachable, or OVER_LINK_BUDGET or
+// CANCELLED.
+//
+// The functions taking an `ObstacleSpan` only borrow the obstacles for the
+// duration of the call, and the `ObstacleSet` overloads forward to them.
+template<int D>
+int linkDistance(ObstacleSpan<D> obstacles, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+
+template<int D>
+int linkDistance(const ObstacleSet<D>& obstacles, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {}) {
+	return linkDistance(ObstacleSpan<D>(obstacles), startP, endP, options);
+}
+
+// Free-space decomposition of a fixed obstacle set, precomputed for running
+// many queries against it.
+template<int D>
+struct LinkIndex {
+	ObstacleSet<D> obstacles;
+	Decomposition<D> decomposition;
+	// Locates the cells of query points, and finds the cells of
+	// `decomposition` to repair in `updateLinkIndex`.
+	CellGrid<D> cellGrid;
+	// Connected component of each cell of `decomposition`. Points in different
+	// components are not reachable from each other.
+	std::vector<int> components;
+	// The labels in `components` are below this. Labels dropped by
+	// `updateLinkIndex` are not reused.
+	int componentLabels = 0;
+	// Unique identifier of the built index. Results cached for an index are
+	// not reused for another one.
+	unsigned long id = 0;
+};
+
+// Decomposes the free space of `obstacles` and labels its components.
+template<int D>
+LinkIndex<D> buildLinkIndex(ObstacleSet<D> obstacles);
+
+// Removes the obstacles at indices `removed` from `index` and adds `added`,
+// repairing the decomposition with `updateDecomposition` and the components
+// with `updateComponents`. The index gets a new id, so results cached for it
+// before the update are not used. Returns the indices of the added obstacles.
+template<int D>
+std::vector<int> updateLinkIndex(LinkIndex<D>& index, const std::vector<int>& removed, const ObstacleSet<D>& added);
+
+// Same as `LinkIndex`, but refers to obstacles owned by the caller instead of
+// copying them. The obstacles must stay unchanged while the index is used.
+template<int D>
+struct BorrowedLinkIndex {
+	explicit BorrowedLinkIndex(ObstacleSpan<D> obstacles): obstacles(obstacles) {}
+
+	ObstacleSpan<D> obstacles;
+	Decomposition<D> decomposition;
+	CellGrid<D> cellGrid;
+	std::vector<int> components;
+	unsigned long id = 0;
+};
+
+// Decomposes the free space of `obstacles` and labels its components without
+// copying the obstacles.
+template<int D>
+BorrowedLinkIndex<D> borrowLinkIndex(ObstacleSpan<D> obstacles);
+
+// Same as `linkDistance` above, but reuses the decomposition of `index`.
+// Returns -1 without illuminating if the end points are in different
+// components or inside obstacles.
+template<int D>
+int linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+
+template<int D>
+int linkDistance(const BorrowedLinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+
+// Bounded cache of `linkDistance` results on `LinkIndex` objects, keyed by
+// the index and the end points. Distances may differ between points of the
+// same cell, so the points are used instead of their cells. May be shared by
+// concurrent queries.
+template<int D>
+class LinkDistanceCache {
+public:
+	// Cache holding at most `capacity` results.
+	explicit LinkDistanceCache(size_t capacity): cache(capacity) {}
+
+	// Returns `linkDistance(index, startP, endP, options)`, using the cached
+	// result if one exists. Results of cancelled queries and queries stopped
+	// by `options.maxLinks` are not cached.
+	int linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+
+	void clear() { cache.clear(); }
+
+private:
+	struct Key {
+		unsigned long index;
+		Point<D> start, end;
+		bool operator==(const Key& k) const {
+			return index == k.index && start == k.start && end == k.end;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& k) const;
+	};
+
+	LruCache<Key, int, KeyHash> cache;
+};
+
+// Illumination buffers reused between `linkDistance` queries on a `LinkIndex`.
+// The buffers are sized by the index, so the first query on an index
+// allocates them, and later queries on the same index only reset them. Used
+// by one query at a time, so each worker thread needs its own workspace.
+template<int D>
+class QueryWorkspace {
+public:
+	QueryWorkspace();
+	~QueryWorkspace();
+	QueryWorkspace(QueryWorkspace&&);
+	QueryWorkspace& operator=(QueryWorkspace&&);
+
+	// Returns `linkDistance(index, startP, endP, options)`. Bidirectional
+	// queries do not use the buffers. A cancelled query leaves the buffers in
+	// an unknown state, so they are rebuilt on the next query.
+	int linkDistance(const LinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+	int linkDistance(const BorrowedLinkIndex<D>& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options = {});
+
+	// Frees the buffers.
+	void clear();
+
+private:
+	struct Buffers;
+	std::unique_ptr<Buffers> buffers;
+
+	template<class Index>
+	int query(const Index& index, Point<D> startP, Point<D> endP, const LinkDistanceOptions& options);
+};
+
+// Computes a minimum-link path between `startP` and `endP`. Returns the
+// vertices of the path from `startP` to `endP`, where consecutive vertices
+// differ in a single coordinate, or an empty vector if either point is not in
+// free space or `endP` is unreachable. Keeps the lit boxes of every round until
+// the path is traced, so the memory used grows with the lit area rather than
+// with the frontier.
+template<int D>
+std::vector<Point<D>> minLinkPath(ObstacleSpan<D> obstacles, Point<D> startP, Point<D> endP);
+
+template<int D>
+std::vector<Point<D>> minLinkPath(const ObstacleSet<D>& obstacles, Point<D> startP, Point<D> endP) {
+	return minLinkPath(ObstacleSpan<D>(obstacles), startP, endP);
+}
+
+// Returns the regions reachable from `startP` with at most k links for each k
+// in [0, maxLinks]. Each region is given as a set of disjoint boxes. Returns an
+// empty vector if `startP` is not in free space.
+template<int D>
+std::vector<std::vector<Box<D>>> linkIsochrones(ObstacleSpan<D> obstacles, Point<D> startP, int maxLinks);
+
+template<int D>
+std::vector<std::vector<Box<D>>> linkIsochrones(const ObstacleSet<D>& obstacles, Point<D> startP, int maxLinks) {
+	return linkIsochrones(ObstacleSpan<D>(obstacles), startP, maxLinks);
+}
+
+// Target reached by `nearestTargets`.
+struct TargetDistance {
+	// Index of the target.
+	int target;
+	// Link distance from the nearest source.
+	int distance;
+};
+
+// Returns the `k` targets with the smallest link distance from any of
+// `sources`, ordered by the distance and then by the index, with a single
+// illumination seeded from all the sources. The illumination stops on the
+// round where `k` targets have been reached, so k=1 finds the nearest target.
+// Returns fewer than `k` targets if fewer are reachable.
+template<int D>
+std::vector<TargetDistance> nearestTargets(ObstacleSpan<D> obstacles, const std::vector<Point<D>>& sources,
+		const std::vector<Point<D>>& targets, int k);
+
+template<int D>
+std::vector<TargetDistance> nearestTargets(const ObstacleSet<D>& obstacles, const std::vector<Point<D>>& sources,
+		const std::vector<Point<D>>& targets, int k) {
+	return nearestTargets(ObstacleSpan<D>(obstacles), sources, targets, k);
+}
+
+// Same as `nearestTargets` above, but reuses the decomposition of `index`.
+template<int D>
+std::vector<TargetDistance> nearestTargets(const LinkIndex<D>& index, const std::vector<Point<D>>& sources,
+		const std::vector<Point<D>>& targets, int k);
+
+// Computes `linkDistance(obstacles, startPoints[i], endPoints[i])` for each i.
+// Up to 64 queries are run at the same time, sharing the sweeps between them.
+template<int D>
+std::vector<int> multiLinkDistance(ObstacleSpan<D> obstacles, const std::vector<Point<D>>& startPoints, const std::vector<Point<D>>& endPoints);
+
 template<int D>
-int linkDistance(const ObstacleSet<D>& obstacles, Point<D> startP, Point<D> endP);
+std::vector<int> multiLinkDistance(const ObstacleSet<D>& obstacles, const std::vector<Point<D>>& startPoints, const std::vector<Point<D>>& endPoints) {
+	return multiLinkDistance(ObstacleSpan<D>(obstacles), startPoints, endPoints);
+}
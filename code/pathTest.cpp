@@ -1,13 +1,37 @@
 #include "path.hpp"
 #include "obstacles.hpp"
 #include "slowPath.hpp"
+#include <atomic>
+#include <cstdlib>
 #include <cstring>
+#include <new>
 #include <random>
 #include <gmock/gmock-more-matchers.h>
 #include <gtest/gtest.h>
 
 namespace {
 
+// Number of allocations with the global operator new.
+std::atomic<long> allocationCount{0};
+
+} // namespace
+
+void* operator new(std::size_t size) {
+	++allocationCount;
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+namespace {
+
 using namespace std;
 
 vector<string> genRandomGrid(int w, int h, mt19937& rng) {
@@ -22,6 +46,30 @@ vector<string> genRandomGrid(int w, int h, mt19937& rng) {
 	return res;
 }
 
+vector<vector<string>> genRandomVolume(int w, int h, int d, mt19937& rng) {
+	vector<vector<string>> res(d, vector<string>(h, string(w, '.')));
+	for(auto& plane: res) {
+		for(string& row: plane) {
+			for(char& c: row) {
+				if (rng() < rng.max()/4) c = '#';
+			}
+		}
+	}
+	return res;
+}
+
+Point<3> randomFreePoint(const vector<vector<string>>& volume, mt19937& rng) {
+	Point<3> res;
+	int w = volume[0][0].size(), h = volume[0].size(), d = volume.size();
+	do {
+		res[0] = rng()%w;
+		res[1] = rng()%h;
+		res[2] = rng()%d;
+	} while(volume[res[2]][res[1]][res[0]] != '.');
+	for(int i=0; i<3; ++i) res[i] += 1;
+	return res;
+}
+
 Point<2> randomFreePoint(const vector<string>& grid, mt19937& rng) {
 	Point<2> res;
 	int w = grid[0].size(), h = grid.size();
@@ -34,6 +82,34 @@ Point<2> randomFreePoint(const vector<string>& grid, mt19937& rng) {
 	return res;
 }
 
+// Checks that `path` is an axis-parallel polyline from `start` to `end`
+// passing only through free cells, where `isFree(p)` tells if the unit cell
+// at `p` is free. Returns the number of links.
+template<int D, class F>
+int checkPath(const vector<Point<D>>& path, Point<D> start, Point<D> end, F&& isFree) {
+	EXPECT_FALSE(path.empty());
+	if (path.empty()) return -1;
+	EXPECT_EQ(path.front(), start);
+	EXPECT_EQ(path.back(), end);
+	for(size_t i=1; i<path.size(); ++i) {
+		Point<D> p = path[i-1], q = path[i];
+		int axis = -1;
+		for(int j=0; j<D; ++j) {
+			if (p[j] == q[j]) continue;
+			EXPECT_EQ(axis, -1) << p << ' ' << q;
+			axis = j;
+		}
+		EXPECT_NE(axis, -1) << p << ' ' << q;
+		if (axis < 0) continue;
+		int step = p[axis] < q[axis] ? 1 : -1;
+		for(; p[axis] != q[axis]; p[axis] += step) {
+			EXPECT_TRUE(isFree(p)) << p;
+		}
+		EXPECT_TRUE(isFree(q)) << q;
+	}
+	return path.size() - 1;
+}
+
 TEST(LinkDistance2D, StartEndPointSame) {
 	ObstacleSet<2> obs = makeObstaclesForPlane({"."});
 	EXPECT_EQ(linkDistance(obs, {1,1}, {1,1}), 0);
@@ -64,6 +140,53 @@ TEST(LinkDistance2D, Infeasible) {
 	EXPECT_EQ(linkDistance(obs, {2,1}, {3,3}), -1);
 }
 
+TEST(LinkDistance2D, DisconnectedSkipsIllumination) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"..#..", "..#..", "..#.."});
+	QueryProgress progress;
+	LinkDistanceOptions options;
+	options.progress = &progress;
+	for(int bidirectional=0; bidirectional<2; ++bidirectional) {
+		options.bidirectional = bidirectional;
+		EXPECT_EQ(linkDistance(obs, {1,1}, {5,3}, options), -1);
+		EXPECT_EQ(progress.roundsCompleted, 0);
+	}
+}
+
+TEST(LinkDistance2D, ShortPathsSkipIllumination) {
+	ObstacleSet<2> obs = makeObstaclesForPlane(
+		{"...#.",
+		 ".#...",
+		 "....."});
+	QueryProgress progress;
+	LinkDistanceOptions options;
+	options.progress = &progress;
+	EXPECT_EQ(linkDistance(obs, {1,1}, {3,1}, options), 1);
+	EXPECT_EQ(progress.roundsCompleted, 0);
+	EXPECT_EQ(linkDistance(obs, {1,1}, {5,3}, options), 2);
+	EXPECT_EQ(progress.roundsCompleted, 0);
+	options.maxLinks = 1;
+	EXPECT_EQ(linkDistance(obs, {1,1}, {5,3}, options), OVER_LINK_BUDGET);
+	options.maxLinks = -1;
+	EXPECT_EQ(linkDistance(obs, {1,1}, {5,1}, options), 3);
+	EXPECT_GT(progress.roundsCompleted, 0);
+}
+
+TEST(LinkDistance2D, AlignedRandomTest) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		for(int j=0; j<10; ++j) {
+			Point<2> start = randomFreePoint(grid, rng);
+			Point<2> end = randomFreePoint(grid, rng);
+			if (j%2) end[0] = start[0];
+			if (grid[end[1]-1][end[0]-1] != '.') continue;
+			EXPECT_EQ(linkDistance(obs, start, end), slowLinkDistance(obs, start, end))
+				<< start << ' ' << end;
+		}
+	}
+}
+
 TEST(LinkDistance2D, ManyPaths) {
 	ObstacleSet<2> obs = makeObstaclesForPlane(
 		{".#...",
@@ -128,4 +251,495 @@ TEST(LinkDistance3D, AroundObstacle) {
 	EXPECT_EQ(linkDistance(obs, {1,1,1}, {1,2,2}), 5);
 }
 
+TEST(LinkDistance3D, RandomTest) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(6, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		Point<3> start = randomFreePoint(volume, rng);
+		Point<3> end = randomFreePoint(volume, rng);
+		EXPECT_EQ(linkDistance(obs, start, end),
+				slowLinkDistance(obs, start, end)) << start << ' ' << end;
+	}
+}
+
+TEST(LinkIndex2D, SameAsLinkDistance) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		LinkIndex<2> index = buildLinkIndex(obs);
+		for(int j=0; j<5; ++j) {
+			Point<2> start = randomFreePoint(grid, rng);
+			Point<2> end = randomFreePoint(grid, rng);
+			EXPECT_EQ(linkDistance(index, start, end), linkDistance(obs, start, end))
+				<< start << ' ' << end;
+		}
+	}
+}
+
+TEST(LinkIndex3D, SameAsLinkDistance) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(5, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		LinkIndex<3> index = buildLinkIndex(obs);
+		for(int j=0; j<5; ++j) {
+			Point<3> start = randomFreePoint(volume, rng);
+			Point<3> end = randomFreePoint(volume, rng);
+			EXPECT_EQ(linkDistance(index, start, end), linkDistance(obs, start, end))
+				<< start << ' ' << end;
+		}
+	}
+}
+
+TEST(LinkIndex2D, Update) {
+	LinkDistanceCache<2> cache(8);
+	vector<string> grid = {".....", ".....", "....."};
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+	EXPECT_EQ(cache.linkDistance(index, {1,2}, {5,2}), 1);
+	grid[1][2] = '#';
+	ObstacleSet<2> target = makeObstaclesForPlane(grid);
+	vector<int> removed;
+	for(size_t i=0; i<index.obstacles.size(); ++i) {
+		const Obstacle<2>& o = index.obstacles[i];
+		auto same = [&](const Obstacle<2>& t) { return t.box == o.box && t.direction == o.direction; };
+		if (find_if(target.begin(), target.end(), same) == target.end()) removed.push_back(i);
+	}
+	ObstacleSet<2> added;
+	for(const Obstacle<2>& t: target) {
+		auto same = [&](const Obstacle<2>& o) { return t.box == o.box && t.direction == o.direction; };
+		if (find_if(index.obstacles.begin(), index.obstacles.end(), same) == index.obstacles.end()) added.push_back(t);
+	}
+	updateLinkIndex(index, removed, added);
+	EXPECT_EQ(cache.linkDistance(index, {1,2}, {5,2}), 3);
+	EXPECT_EQ(linkDistance(index, {1,2}, {5,2}), linkDistance(target, {1,2}, {5,2}));
+}
+
+TEST(LinkDistanceCache2D, SameAsLinkDistance) {
+	LinkDistanceCache<2> cache(8);
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+		vector<pair<Point<2>, Point<2>>> queries;
+		for(int j=0; j<12; ++j) {
+			queries.emplace_back(randomFreePoint(grid, rng), randomFreePoint(grid, rng));
+		}
+		for(int j=0; j<40; ++j) {
+			auto q = queries[rng()%queries.size()];
+			EXPECT_EQ(cache.linkDistance(index, q.first, q.second), linkDistance(index, q.first, q.second))
+				<< q.first << ' ' << q.second;
+		}
+	}
+}
+
+TEST(LinkDistanceCache2D, NotSharedBetweenIndexes) {
+	LinkDistanceCache<2> cache(8);
+	LinkIndex<2> open = buildLinkIndex(makeObstaclesForPlane({"...", "...", "..."}));
+	LinkIndex<2> wall = buildLinkIndex(makeObstaclesForPlane({"...", "##.", "..."}));
+	EXPECT_EQ(cache.linkDistance(open, {1,1}, {1,3}), 1);
+	EXPECT_EQ(cache.linkDistance(wall, {1,1}, {1,3}), 3);
+	EXPECT_EQ(cache.linkDistance(open, {1,1}, {1,3}), 1);
+}
+
+TEST(LinkDistanceCache2D, MaxLinks) {
+	LinkDistanceCache<2> cache(8);
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane({"...", "##.", "..."}));
+	LinkDistanceOptions options;
+	options.maxLinks = 2;
+	EXPECT_EQ(cache.linkDistance(index, {1,1}, {1,3}, options), OVER_LINK_BUDGET);
+	EXPECT_EQ(cache.linkDistance(index, {1,1}, {1,3}), 3);
+	EXPECT_EQ(cache.linkDistance(index, {1,1}, {1,3}, options), OVER_LINK_BUDGET);
+	options.maxLinks = 3;
+	EXPECT_EQ(cache.linkDistance(index, {1,1}, {1,3}, options), 3);
+}
+
+TEST(QueryWorkspace2D, SameAsLinkDistance) {
+	QueryWorkspace<2> workspace;
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto other = genRandomGrid(16, 16, rng);
+		LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+		LinkIndex<2> otherIndex = buildLinkIndex(makeObstaclesForPlane(other));
+		CancelToken cancelled;
+		cancelled.cancel();
+		for(int j=0; j<20; ++j) {
+			Point<2> start = randomFreePoint(grid, rng);
+			Point<2> end = randomFreePoint(grid, rng);
+			LinkDistanceOptions options;
+			options.maxLinks = j%3 == 0 ? 3 : -1;
+			EXPECT_EQ(workspace.linkDistance(index, start, end, options), linkDistance(index, start, end, options))
+				<< start << ' ' << end;
+			if (j%5 == 0) {
+				LinkDistanceOptions cancelOptions;
+				cancelOptions.cancel = &cancelled;
+				int dist = workspace.linkDistance(index, start, end, cancelOptions);
+				if (dist != CANCELLED) {
+					EXPECT_EQ(dist, linkDistance(index, start, end));
+				}
+			}
+			if (j%7 == 0) {
+				Point<2> p = randomFreePoint(other, rng);
+				Point<2> q = randomFreePoint(other, rng);
+				EXPECT_EQ(workspace.linkDistance(otherIndex, p, q), linkDistance(otherIndex, p, q)) << p << ' ' << q;
+			}
+		}
+	}
+}
+
+TEST(BorrowedLinkIndex2D, SameAsLinkIndex) {
+	QueryWorkspace<2> workspace;
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		ObstacleSet<2> obstacles = makeObstaclesForPlane(grid);
+		LinkIndex<2> index = buildLinkIndex(obstacles);
+		BorrowedLinkIndex<2> borrowed = borrowLinkIndex(ObstacleSpan<2>(obstacles));
+		EXPECT_EQ(borrowed.obstacles.data(), obstacles.data());
+		EXPECT_NE(borrowed.id, index.id);
+		for(int j=0; j<20; ++j) {
+			Point<2> start = randomFreePoint(grid, rng);
+			Point<2> end = randomFreePoint(grid, rng);
+			int dist = linkDistance(index, start, end);
+			EXPECT_EQ(linkDistance(borrowed, start, end), dist) << start << ' ' << end;
+			EXPECT_EQ(workspace.linkDistance(borrowed, start, end), dist) << start << ' ' << end;
+			EXPECT_EQ(workspace.linkDistance(index, start, end), dist) << start << ' ' << end;
+		}
+	}
+}
+
+TEST(QueryWorkspace3D, SameAsLinkDistance) {
+	QueryWorkspace<3> workspace;
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(5, 5, 5, rng);
+		LinkIndex<3> index = buildLinkIndex(makeObstaclesForVolume(volume));
+		for(int j=0; j<10; ++j) {
+			Point<3> start = randomFreePoint(volume, rng);
+			Point<3> end = randomFreePoint(volume, rng);
+			EXPECT_EQ(workspace.linkDistance(index, start, end), linkDistance(index, start, end))
+				<< start << ' ' << end;
+		}
+	}
+}
+
+TEST(QueryWorkspace2D, NoAllocationAfterWarmup) {
+	mt19937 rng(0);
+	auto grid = genRandomGrid(16, 16, rng);
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+	vector<pair<Point<2>, Point<2>>> queries;
+	for(int i=0; i<20; ++i) {
+		queries.emplace_back(randomFreePoint(grid, rng), randomFreePoint(grid, rng));
+	}
+	QueryWorkspace<2> workspace;
+	vector<int> expected, dists(queries.size());
+	for(auto q: queries) expected.push_back(workspace.linkDistance(index, q.first, q.second));
+	long before = allocationCount;
+	for(size_t i=0; i<queries.size(); ++i) {
+		dists[i] = workspace.linkDistance(index, queries[i].first, queries[i].second);
+	}
+	EXPECT_EQ(allocationCount - before, 0);
+	EXPECT_EQ(dists, expected);
+}
+
+// Returns `nearestTargets` computed by pairwise `linkDistance` queries as
+// (distance, target) pairs.
+template<int D>
+vector<pair<int,int>> slowNearestTargets(const ObstacleSet<D>& obs, const vector<Point<D>>& sources,
+		const vector<Point<D>>& targets, size_t k) {
+	vector<pair<int,int>> res;
+	for(size_t t=0; t<targets.size(); ++t) {
+		int best = -1;
+		for(Point<D> s: sources) {
+			int dist = linkDistance(obs, s, targets[t]);
+			if (dist >= 0 && (best < 0 || dist < best)) best = dist;
+		}
+		if (best >= 0) res.emplace_back(best, t);
+	}
+	sort(res.begin(), res.end());
+	res.resize(min(res.size(), k));
+	return res;
+}
+
+vector<pair<int,int>> distancePairs(const vector<TargetDistance>& v) {
+	vector<pair<int,int>> res;
+	for(const TargetDistance& t: v) res.emplace_back(t.distance, t.target);
+	return res;
+}
+
+TEST(NearestTargets2D, RandomTest) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		LinkIndex<2> index = buildLinkIndex(obs);
+		vector<Point<2>> sources(1 + i%3), targets(8);
+		for(auto& p: sources) p = randomFreePoint(grid, rng);
+		for(auto& p: targets) p = randomFreePoint(grid, rng);
+		targets[0] = sources[0];
+		for(size_t k: {1, 3, 8}) {
+			EXPECT_EQ(distancePairs(nearestTargets(index, sources, targets, k)),
+					slowNearestTargets(obs, sources, targets, k)) << i << ' ' << k;
+		}
+	}
+}
+
+TEST(NearestTargets3D, RandomTest) {
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(5, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		vector<Point<3>> sources(2), targets(6);
+		for(auto& p: sources) p = randomFreePoint(volume, rng);
+		for(auto& p: targets) p = randomFreePoint(volume, rng);
+		EXPECT_EQ(distancePairs(nearestTargets(obs, sources, targets, 6)),
+				slowNearestTargets(obs, sources, targets, 6));
+	}
+}
+
+TEST(NearestTargets2D, UnreachableTarget) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"..#..", "..#.."});
+	auto res = nearestTargets(obs, {{1,1}}, {{5,1}, {2,2}, {1,2}}, 3);
+	EXPECT_EQ(distancePairs(res), (vector<pair<int,int>>{{1,2}, {2,1}}));
+}
+
+TEST(Bidirectional2D, RandomTest) {
+	LinkDistanceOptions options;
+	options.bidirectional = true;
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(32, 32, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		Point<2> start = randomFreePoint(grid, rng);
+		Point<2> end = i ? randomFreePoint(grid, rng) : start;
+		EXPECT_EQ(linkDistance(obs, start, end, options),
+				linkDistance(obs, start, end)) << start << ' ' << end;
+	}
+}
+
+TEST(Bidirectional3D, RandomTest) {
+	LinkDistanceOptions options;
+	options.bidirectional = true;
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(6, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		Point<3> start = randomFreePoint(volume, rng);
+		Point<3> end = randomFreePoint(volume, rng);
+		EXPECT_EQ(linkDistance(obs, start, end, options),
+				slowLinkDistance(obs, start, end)) << start << ' ' << end;
+	}
+}
+
+TEST(MaxLinks2D, RandomTest) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		Point<2> start = randomFreePoint(grid, rng);
+		Point<2> end = randomFreePoint(grid, rng);
+		int dist = linkDistance(obs, start, end);
+		for(int bidirectional=0; bidirectional<2; ++bidirectional) {
+			LinkDistanceOptions options;
+			options.bidirectional = bidirectional;
+			for(options.maxLinks=0; options.maxLinks<=max(dist, 0)+1; ++options.maxLinks) {
+				int res = linkDistance(obs, start, end, options);
+				if (dist < 0) {
+					EXPECT_TRUE(res == -1 || res == OVER_LINK_BUDGET) << res;
+				} else {
+					EXPECT_EQ(res, dist <= options.maxLinks ? dist : OVER_LINK_BUDGET)
+						<< start << ' ' << end << ' ' << options.maxLinks;
+				}
+			}
+		}
+	}
+}
+
+TEST(MaxLinks2D, WallBlocksEnd) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"..#.."});
+	LinkDistanceOptions options;
+	options.maxLinks = 3;
+	EXPECT_EQ(linkDistance(obs, {1,1}, {5,1}, options), -1);
+}
+
+TEST(Cancellation2D, CancelledBeforeStart) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"....."});
+	CancelToken cancel;
+	cancel.cancel();
+	QueryProgress progress;
+	LinkDistanceOptions options;
+	options.cancel = &cancel;
+	options.progress = &progress;
+	for(int bidirectional=0; bidirectional<2; ++bidirectional) {
+		options.bidirectional = bidirectional;
+		EXPECT_EQ(linkDistance(obs, {1,1}, {5,1}, options), CANCELLED);
+		EXPECT_FALSE(progress.decomposed);
+		EXPECT_EQ(progress.roundsCompleted, 0);
+	}
+}
+
+TEST(Cancellation2D, ExpiredDeadline) {
+	mt19937 rng(0);
+	auto grid = genRandomGrid(32, 32, rng);
+	auto obs = makeObstaclesForPlane(grid);
+	CancelToken cancel(CancelToken::Clock::now());
+	LinkDistanceOptions options;
+	options.cancel = &cancel;
+	EXPECT_EQ(linkDistance(obs, randomFreePoint(grid, rng), randomFreePoint(grid, rng), options), CANCELLED);
+}
+
+TEST(Cancellation2D, NotCancelled) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		Point<2> start = randomFreePoint(grid, rng);
+		Point<2> end = randomFreePoint(grid, rng);
+		int dist = linkDistance(obs, start, end);
+		CancelToken cancel = CancelToken::withTimeout(chrono::hours(1));
+		QueryProgress progress;
+		LinkDistanceOptions options;
+		options.cancel = &cancel;
+		options.progress = &progress;
+		EXPECT_EQ(linkDistance(obs, start, end, options), dist);
+		EXPECT_TRUE(progress.decomposed);
+		if (dist > 2) {
+			EXPECT_GE(progress.roundsCompleted, dist-1);
+		}
+	}
+}
+
+TEST(LinkIsochrones2D, OutsideFreeSpace) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"...", ".#.", "..."});
+	EXPECT_TRUE(linkIsochrones(obs, {2,2}, 3).empty());
+	EXPECT_TRUE(linkIsochrones(obs, {10,10}, 3).empty());
+	EXPECT_EQ(linkIsochrones(obs, {1,1}, 3).size(), 4u);
+}
+
+TEST(LinkIsochrones2D, RandomTest) {
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(8, 8, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		Point<2> start = randomFreePoint(grid, rng);
+		const int maxLinks = 4;
+		auto regions = linkIsochrones(obs, start, maxLinks);
+		ASSERT_EQ(regions.size(), maxLinks+1u);
+		for(int y=0; y<(int)grid.size(); ++y) {
+			for(int x=0; x<(int)grid[y].size(); ++x) {
+				if (grid[y][x] != '.') continue;
+				Point<2> p = {x+1, y+1};
+				int dist = slowLinkDistance(obs, start, p);
+				for(int k=0; k<=maxLinks; ++k) {
+					int count = 0;
+					for(const Box<2>& b: regions[k]) count += b.contains(p);
+					EXPECT_EQ(count, dist >= 0 && dist <= k) << start << ' ' << p << ' ' << k;
+				}
+			}
+		}
+	}
+}
+
+TEST(MinLinkPath2D, SameCell) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"."});
+	EXPECT_EQ(minLinkPath(obs, {1,1}, {1,1}), vector<Point<2>>({{1,1}}));
+}
+
+TEST(MinLinkPath2D, AroundObstacle) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"...", ".#.", "..."});
+	vector<Point<2>> path = minLinkPath(obs, {1,1}, {3,3});
+	EXPECT_EQ(path.size(), 3u);
+	EXPECT_TRUE(path[1] == Point<2>({1,3}) || path[1] == Point<2>({3,1})) << path[1];
+}
+
+TEST(MinLinkPath2D, OutsideFreeSpace) {
+	ObstacleSet<2> obs = makeObstaclesForPlane({"...", ".#.", "..."});
+	EXPECT_TRUE(minLinkPath(obs, {2,2}, {1,1}).empty());
+	EXPECT_TRUE(minLinkPath(obs, {1,1}, {2,2}).empty());
+	EXPECT_TRUE(minLinkPath(obs, {1,1}, {10,10}).empty());
+	EXPECT_TRUE(minLinkPath(obs, {-5,1}, {1,1}).empty());
+	EXPECT_TRUE(minLinkPath(makeObstaclesForPlane({".#."}), {1,1}, {3,1}).empty());
+}
+
+TEST(MinLinkPath2D, RandomTest) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(32, 32, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		Point<2> start = randomFreePoint(grid, rng);
+		Point<2> end = randomFreePoint(grid, rng);
+		int dist = linkDistance(obs, start, end);
+		vector<Point<2>> path = minLinkPath(obs, start, end);
+		if (dist < 0) {
+			EXPECT_TRUE(path.empty());
+			continue;
+		}
+		EXPECT_EQ(checkPath(path, start, end, [&](Point<2> p) {
+			return grid[p[1]-1][p[0]-1] == '.';
+		}), dist) << start << ' ' << end;
+	}
+}
+
+TEST(MinLinkPath3D, RandomTest) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(6, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		Point<3> start = randomFreePoint(volume, rng);
+		Point<3> end = randomFreePoint(volume, rng);
+		int dist = linkDistance(obs, start, end);
+		vector<Point<3>> path = minLinkPath(obs, start, end);
+		if (dist < 0) {
+			EXPECT_TRUE(path.empty());
+			continue;
+		}
+		EXPECT_EQ(checkPath(path, start, end, [&](Point<3> p) {
+			return volume[p[2]-1][p[1]-1][p[0]-1] == '.';
+		}), dist) << start << ' ' << end;
+	}
+}
+
+TEST(MultiLinkDistance2D, SameAsSingle) {
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto grid = genRandomGrid(16, 16, rng);
+		auto obs = makeObstaclesForPlane(grid);
+		vector<Point<2>> starts, ends;
+		// More queries than lanes, with some sharing the start point.
+		for(int j=0; j<70; ++j) {
+			Point<2> start = j%3 || starts.empty() ? randomFreePoint(grid, rng) : starts.back();
+			starts.push_back(start);
+			ends.push_back(j%7 ? randomFreePoint(grid, rng) : start);
+		}
+		vector<int> res = multiLinkDistance(obs, starts, ends);
+		ASSERT_EQ(res.size(), starts.size());
+		for(size_t j=0; j<starts.size(); ++j) {
+			int expected = slowLinkDistance(obs, starts[j], ends[j]);
+			EXPECT_EQ(res[j], expected) << starts[j] << ' ' << ends[j];
+			EXPECT_EQ(linkDistance(obs, starts[j], ends[j]), expected) << starts[j] << ' ' << ends[j];
+		}
+	}
+}
+
+TEST(MultiLinkDistance3D, SameAsSingle) {
+	for(int i=0; i<5; ++i) {
+		mt19937 rng(i);
+		auto volume = genRandomVolume(6, 5, 5, rng);
+		auto obs = makeObstaclesForVolume(volume);
+		vector<Point<3>> starts, ends;
+		for(int j=0; j<20; ++j) {
+			starts.push_back(randomFreePoint(volume, rng));
+			ends.push_back(randomFreePoint(volume, rng));
+		}
+		vector<int> res = multiLinkDistance(obs, starts, ends);
+		for(size_t j=0; j<starts.size(); ++j) {
+			int expected = slowLinkDistance(obs, starts[j], ends[j]);
+			EXPECT_EQ(res[j], expected) << starts[j] << ' ' << ends[j];
+			EXPECT_EQ(linkDistance(obs, starts[j], ends[j]), expected) << starts[j] << ' ' << ends[j];
+		}
+	}
+}
+
 } // namespace
@@ -0,0 +1,189 @@
+#include "queryStream.hpp"
+
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+template<int D>
+struct QueryBlock {
+	// Position of the block in the input.
+	long seq = 0;
+	vector<Point<D>> starts;
+	vector<Point<D>> ends;
+	vector<int> results;
+};
+
+bool onlySpace(const char* p) {
+	for(; *p; ++p) if (!isspace((unsigned char)*p)) return false;
+	return true;
+}
+
+// Parses a query line into `start` and `end`. Returns 1 on success, 0 for an
+// empty line and -1 for a malformed line.
+template<int D>
+int parseQuery(const string& line, Point<D>& start, Point<D>& end) {
+	const char* p = line.c_str();
+	for(int k=0; k<2*D; ++k) {
+		char* next;
+		long x = strtol(p, &next, 10);
+		if (next == p) return k == 0 && onlySpace(p) ? 0 : -1;
+		if (x < INT_MIN || x > INT_MAX) return -1;
+		(k < D ? start[k] : end[k-D]) = x;
+		p = next;
+	}
+	return onlySpace(p) ? 1 : -1;
+}
+
+} // namespace
+
+// The calling thread reads the blocks, the workers answer them and a writer
+// thread writes them in order. A block counts towards `maxBlocks` from the
+// time the reader takes it until the writer has written it, after which it is
+// reused for reading.
+template<int D>
+bool runQueryStream(const LinkIndex<D>& index, istream& in, ostream& out,
+		const QueryStreamOptions& options, QueryStreamStats& stats, string& error) {
+	typedef unique_ptr<QueryBlock<D>> BlockPtr;
+	Clock::time_point begin = Clock::now();
+	const int threads = max(options.threads, 1);
+	const size_t blockSize = max(options.blockSize, 1);
+	const int maxBlocks = max(options.maxBlocks, 1);
+
+	mutex m;
+	condition_variable changed;
+	deque<BlockPtr> todo;
+	map<long, BlockPtr> done;
+	vector<BlockPtr> freeBlocks;
+	int blocksInUse = 0;
+	long blocksRead = 0;
+	bool endOfInput = false;
+
+	vector<LatencyHistogram> latencies(threads);
+	vector<thread> workers;
+	for(int w=0; w<threads; ++w) {
+		workers.emplace_back([&, w] {
+			QueryWorkspace<D> workspace;
+			LinkDistanceOptions queryOptions;
+			queryOptions.maxLinks = options.maxLinks;
+			while(true) {
+				BlockPtr block;
+				{
+					unique_lock<mutex> lock(m);
+					changed.wait(lock, [&]{ return !todo.empty() || endOfInput; });
+					if (todo.empty()) return;
+					block = move(todo.front());
+					todo.pop_front();
+				}
+				block->results.resize(block->starts.size());
+				for(size_t i=0; i<block->starts.size(); ++i) {
+					Clock::time_point start = Clock::now();
+					block->results[i] = workspace.linkDistance(index, block->starts[i], block->ends[i], queryOptions);
+					latencies[w].add(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+				}
+				lock_guard<mutex> lock(m);
+				done[block->seq] = move(block);
+				changed.notify_all();
+			}
+		});
+	}
+	thread writer([&] {
+		string buffer;
+		for(long next=0; ; ++next) {
+			BlockPtr block;
+			{
+				unique_lock<mutex> lock(m);
+				changed.wait(lock, [&]{ return done.count(next) || (endOfInput && next == blocksRead); });
+				if (!done.count(next)) return;
+				block = move(done[next]);
+				done.erase(next);
+			}
+			buffer.clear();
+			for(int r: block->results) {
+				buffer += to_string(r);
+				buffer += '\n';
+			}
+			out.write(buffer.data(), buffer.size());
+			block->starts.clear();
+			block->ends.clear();
+			lock_guard<mutex> lock(m);
+			freeBlocks.push_back(move(block));
+			--blocksInUse;
+			changed.notify_all();
+		}
+	});
+
+	auto takeBlock = [&] {
+		unique_lock<mutex> lock(m);
+		changed.wait(lock, [&]{ return blocksInUse < maxBlocks; });
+		++blocksInUse;
+		if (freeBlocks.empty()) return BlockPtr(new QueryBlock<D>());
+		BlockPtr block = move(freeBlocks.back());
+		freeBlocks.pop_back();
+		return block;
+	};
+	auto submit = [&](BlockPtr& block) {
+		lock_guard<mutex> lock(m);
+		block->seq = blocksRead++;
+		todo.push_back(move(block));
+		changed.notify_all();
+	};
+
+	bool ok = true;
+	string line;
+	BlockPtr block = takeBlock();
+	for(long lineNumber=1; getline(in, line); ++lineNumber) {
+		Point<D> start, end;
+		int parsed = parseQuery(line, start, end);
+		if (parsed == 0) continue;
+		if (parsed < 0) {
+			error = "line " + to_string(lineNumber) + ": expected " + to_string(2*D) + " integers";
+			ok = false;
+			break;
+		}
+		block->starts.push_back(start);
+		block->ends.push_back(end);
+		++stats.queries;
+		if (block->starts.size() == blockSize) {
+			submit(block);
+			block = takeBlock();
+		}
+	}
+	{
+		lock_guard<mutex> lock(m);
+		if (!block->starts.empty()) {
+			block->seq = blocksRead++;
+			todo.push_back(move(block));
+		} else {
+			--blocksInUse;
+		}
+		endOfInput = true;
+		changed.notify_all();
+	}
+	for(thread& t: workers) t.join();
+	writer.join();
+	out.flush();
+
+	for(const LatencyHistogram& h: latencies) stats.latency.merge(h);
+	stats.seconds = chrono::duration<double>(Clock::now() - begin).count();
+	return ok;
+}
+
+template
+bool runQueryStream<2>(const LinkIndex<2>& index, istream& in, ostream& out,
+		const QueryStreamOptions& options, QueryStreamStats& stats, string& error);
+template
+bool runQueryStream<3>(const LinkIndex<3>& index, istream& in, ostream& out,
+		const QueryStreamOptions& options, QueryStreamStats& stats, string& error);
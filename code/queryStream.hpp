@@ -0,0 +1,39 @@
+#pragma once
+
+#include "LatencyHistogram.hpp"
+#include "path.hpp"
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Options for `runQueryStream`.
+struct QueryStreamOptions {
+	// Number of worker threads answering the queries.
+	int threads = 1;
+	// Link budget of each query as in `LinkDistanceOptions::maxLinks`.
+	int maxLinks = -1;
+	// Number of queries handed to a worker at a time.
+	int blockSize = 1024;
+	// Largest number of blocks read but not yet written. Bounds the memory
+	// used for the queries and the results waiting to be written in order.
+	int maxBlocks = 64;
+};
+
+// Statistics of a `runQueryStream` run.
+struct QueryStreamStats {
+	long queries = 0;
+	// Wall-clock time of the whole run.
+	double seconds = 0;
+	// Time taken by each `linkDistance` call.
+	LatencyHistogram latency;
+};
+
+// Reads queries from `in`, one per line as the coordinates of the start and
+// the end point separated by whitespace, answers them on `index` in parallel
+// and writes the distances to `out` in input order, one per line. Empty lines
+// are skipped. Returns false and sets `error` on a malformed line, after
+// writing the results of the lines before it.
+template<int D>
+bool runQueryStream(const LinkIndex<D>& index, std::istream& in, std::ostream& out,
+		const QueryStreamOptions& options, QueryStreamStats& stats, std::string& error);
@@ -0,0 +1,69 @@
+#include "queryStream.hpp"
+#include "obstacles.hpp"
+
+#include <random>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+TEST(QueryStreamTest, ResultsInInputOrder) {
+	mt19937 rng(0);
+	vector<string> grid(16, string(16, '.'));
+	for(string& row: grid) {
+		for(char& c: row) c = rng()%4 ? '.' : '#';
+	}
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane(grid));
+	ostringstream input, expected;
+	for(int i=0; i<200; ++i) {
+		Point<2> s{int(rng()%16 + 1), int(rng()%16 + 1)};
+		Point<2> e{int(rng()%16 + 1), int(rng()%16 + 1)};
+		input << s[0] << ' ' << s[1] << '\t' << e[0] << ' ' << e[1] << '\n';
+		if (i%50 == 0) input << "\n";
+		expected << linkDistance(index, s, e) << '\n';
+	}
+	for(int threads: {1, 3}) {
+		QueryStreamOptions options;
+		options.threads = threads;
+		options.blockSize = 7;
+		options.maxBlocks = 2;
+		istringstream in(input.str());
+		ostringstream out;
+		QueryStreamStats stats;
+		string error;
+		EXPECT_TRUE(runQueryStream(index, in, out, options, stats, error)) << error;
+		EXPECT_EQ(out.str(), expected.str());
+		EXPECT_EQ(stats.queries, 200);
+		EXPECT_EQ(stats.latency.count(), 200u);
+	}
+}
+
+TEST(QueryStreamTest, MaxLinks) {
+	LinkIndex<2> index = buildLinkIndex(makeObstaclesForPlane({"...", "##.", "..."}));
+	istringstream in("1 1 1 3\n1 1 3 1\n");
+	ostringstream out;
+	QueryStreamOptions options;
+	options.maxLinks = 2;
+	QueryStreamStats stats;
+	string error;
+	EXPECT_TRUE(runQueryStream(index, in, out, options, stats, error));
+	EXPECT_EQ(out.str(), to_string(OVER_LINK_BUDGET) + "\n1\n");
+}
+
+TEST(QueryStreamTest, MalformedLine) {
+	LinkIndex<3> index = buildLinkIndex(makeObstaclesForVolume({{"..", ".."}, {"..", ".."}}));
+	istringstream in("1 1 1 2 2 2\n1 1 1 2 2\n1 1 1 1 1 1\n");
+	ostringstream out;
+	QueryStreamOptions options;
+	options.blockSize = 1;
+	QueryStreamStats stats;
+	string error;
+	EXPECT_FALSE(runQueryStream(index, in, out, options, stats, error));
+	EXPECT_EQ(error, "line 2: expected 6 integers");
+	EXPECT_EQ(out.str(), "3\n");
+}
+
+} // namespace
@@ -0,0 +1,81 @@
+#include "rayShooting.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+template<int D>
+RayIndex<D>::RayIndex(ObstacleSpan<D> obstacles) {
+	positions.resize(obstacles.size());
+	vector<Box<D-1>> boxes[2*D];
+	vector<int> ids[2*D];
+	for(int i=0; i<obstacles.size(); ++i) {
+		const Obstacle<D>& obs = obstacles[i];
+		if (obs.direction < 0) continue;
+		int axis = obs.direction/2;
+		positions[i] = obs.box[axis].from;
+		// Rays in direction `dir` hit the obstacles with direction `dir^1`,
+		// like `Cell::obstacles`.
+		int dir = obs.direction^1;
+		boxes[dir].push_back(obs.box.project(axis));
+		ids[dir].push_back(i);
+	}
+	for(int dir=0; dir<2*D; ++dir) {
+		trees[dir] = StabbingTree<D-1>(boxes[dir], ids[dir]);
+		trees[dir].forEachBucket([&](vector<int>& bucket) {
+			sort(bucket.begin(), bucket.end(), [&](int a, int b) {
+				return positions[a] < positions[b];
+			});
+		});
+	}
+}
+
+template<int D>
+RayHit RayIndex<D>::shoot(Point<D> p, int dir) const {
+	int axis = dir/2;
+	Point<D-1> q;
+	for(int i=0, j=0; i<D; ++i) {
+		if (i != axis) q[j++] = p[i];
+	}
+	RayHit res;
+	auto better = [&](int i) {
+		if (res.obstacle < 0) return true;
+		return dir&1 ? positions[i] < res.position : positions[i] > res.position;
+	};
+	trees[dir].stab(q, [&](const vector<int>& bucket) {
+		// The obstacles above the unit box at `p` start from `it`.
+		auto it = lower_bound(bucket.begin(), bucket.end(), p[axis]+1, [&](int i, int pos) {
+			return positions[i] < pos;
+		});
+		int hit = -1;
+		if (dir&1) {
+			if (it != bucket.end()) hit = *it;
+		} else {
+			if (it != bucket.begin()) hit = *--it;
+		}
+		if (hit >= 0 && better(hit)) {
+			res.obstacle = hit;
+			res.position = positions[hit];
+		}
+	});
+	return res;
+}
+
+template<int D>
+bool RayIndex<D>::visible(Point<D> from, Point<D> to) const {
+	int axis = -1;
+	for(int i=0; i<D; ++i) {
+		if (from[i] == to[i]) continue;
+		assert(axis < 0);
+		axis = i;
+	}
+	if (axis < 0) return true;
+	bool up = to[axis] > from[axis];
+	RayHit hit = shoot(from, 2*axis + up);
+	if (hit.obstacle < 0) return true;
+	return up ? to[axis] < hit.position : to[axis] >= hit.position;
+}
+
+template class RayIndex<2>;
+template class RayIndex<3>;
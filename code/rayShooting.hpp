@@ -0,0 +1,45 @@
+#pragma once
+#include "Box.hpp"
+#include "decomposition.hpp"
+#include "StabbingTree.hpp"
+
+#include <vector>
+
+// Obstacle hit by a ray.
+struct RayHit {
+	// Index of the obstacle, or -1 if the ray does not hit any obstacle.
+	int obstacle = -1;
+	// Coordinate of the obstacle along the axis of the ray.
+	int position = 0;
+};
+
+// Index of the obstacles for shooting axis-parallel rays through the free
+// space.
+//
+// Keeps a `StabbingTree` per direction over the obstacles facing rays in that
+// direction, projected along the axis of the direction. The buckets of the
+// trees are sorted by the obstacle positions, so a ray is answered by a binary
+// search in each of the O(log^(D-1) n) buckets on its path.
+template<int D>
+class RayIndex {
+public:
+	// Only reads `obstacles` during the construction.
+	explicit RayIndex(ObstacleSpan<D> obstacles);
+	explicit RayIndex(const ObstacleSet<D>& obstacles): RayIndex(ObstacleSpan<D>(obstacles)) {}
+
+	// Returns the first obstacle hit by a ray from the unit box at `p` in
+	// direction `dir`. The ray stops in front of the obstacle, so the free
+	// space along the ray extends up to `position` in positive directions and
+	// down to `position` in negative directions. `p` must be in the free space.
+	RayHit shoot(Point<D> p, int dir) const;
+
+	// Returns true if the axis-parallel segment between the unit boxes at
+	// `from` and `to` is in the free space. `from` must be in the free space.
+	bool visible(Point<D> from, Point<D> to) const;
+
+private:
+	// Position of each obstacle along its axis.
+	std::vector<int> positions;
+	// Tree of the obstacles hit by rays in each direction.
+	StabbingTree<D-1> trees[2*D];
+};
@@ -0,0 +1,136 @@
+#include "rayShooting.hpp"
+#include "obstacles.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace std;
+
+// Grid of free ('.') and blocked ('#') unit boxes. The unit box at point p is
+// `at(p)`, and the grid is surrounded by blocked boxes.
+template<int D>
+struct Grid {
+	int size;
+	vector<char> cells;
+
+	char at(Point<D> p) const {
+		int idx = 0;
+		for(int i=D-1; i>=0; --i) {
+			if (p[i] < 1 || p[i] > size) return '#';
+			idx = idx*size + p[i]-1;
+		}
+		return cells[idx];
+	}
+};
+
+Grid<2> randomGrid2(int size, mt19937& rng, vector<string>& rows) {
+	Grid<2> grid{size, {}};
+	rows.assign(size, string(size, '.'));
+	for(string& row: rows) {
+		for(char& c: row) {
+			if (rng()%4 == 0) c = '#';
+			grid.cells.push_back(c);
+		}
+	}
+	return grid;
+}
+
+Grid<3> randomGrid3(int size, mt19937& rng, vector<vector<string>>& volume) {
+	Grid<3> grid{size, {}};
+	volume.assign(size, vector<string>(size, string(size, '.')));
+	for(auto& plane: volume) {
+		for(string& row: plane) {
+			for(char& c: row) {
+				if (rng()%4 == 0) c = '#';
+				grid.cells.push_back(c);
+			}
+		}
+	}
+	return grid;
+}
+
+template<int D>
+Point<D> randomFree(const Grid<D>& grid, mt19937& rng) {
+	Point<D> p;
+	do {
+		for(int i=0; i<D; ++i) p[i] = 1 + rng()%grid.size;
+	} while(grid.at(p) != '.');
+	return p;
+}
+
+template<int D>
+void checkRays(const Grid<D>& grid, const ObstacleSet<D>& obstacles, mt19937& rng) {
+	RayIndex<D> index(obstacles);
+	for(int i=0; i<30; ++i) {
+		Point<D> p = randomFree(grid, rng);
+		for(int dir=0; dir<2*D; ++dir) {
+			int axis = dir/2, step = dir&1 ? 1 : -1;
+			Point<D> q = p;
+			while(grid.at(q) == '.') q[axis] += step;
+			RayHit hit = index.shoot(p, dir);
+			ASSERT_GE(hit.obstacle, 0) << p << ' ' << dir;
+			EXPECT_EQ(hit.position, dir&1 ? q[axis] : q[axis]+1) << p << ' ' << dir;
+			const Obstacle<D>& obs = obstacles[hit.obstacle];
+			EXPECT_EQ(obs.direction, dir^1);
+			EXPECT_EQ(obs.box[axis].from, hit.position);
+			for(int j=0; j<D; ++j) {
+				if (j != axis) {
+					EXPECT_TRUE(obs.box[j].contains(p[j]));
+				}
+			}
+			Point<D> to = p;
+			to[axis] = 1 + rng()%grid.size;
+			bool free = true;
+			for(Point<D> r = p; r[axis] != to[axis]; r[axis] += to[axis] > p[axis] ? 1 : -1) {
+				free &= grid.at(r) == '.';
+			}
+			free &= grid.at(to) == '.';
+			EXPECT_EQ(index.visible(p, to), free) << p << ' ' << to;
+		}
+	}
+}
+
+TEST(RayIndexTest2D, Random) {
+	for(int i=0; i<20; ++i) {
+		mt19937 rng(i);
+		vector<string> rows;
+		Grid<2> grid = randomGrid2(12, rng, rows);
+		checkRays(grid, makeObstaclesForPlane(rows), rng);
+	}
+}
+
+TEST(RayIndexTest3D, Random) {
+	for(int i=0; i<10; ++i) {
+		mt19937 rng(i);
+		vector<vector<string>> volume;
+		Grid<3> grid = randomGrid3(6, rng, volume);
+		checkRays(grid, makeObstaclesForVolume(volume), rng);
+	}
+}
+
+TEST(RayIndexTest2D, IgnoresRemovedObstacles) {
+	ObstacleSet<2> obstacles = makeObstaclesForPlane({"...", ".#.", "..."});
+	RayIndex<2> full(obstacles);
+	EXPECT_EQ(full.shoot({2,1}, 3).position, 2);
+	for(Obstacle<2>& obs: obstacles) {
+		if (obs.box[0] == Range{2,3} && obs.box[1] == Range{2,2}) obs.direction = -1;
+	}
+	RayIndex<2> removed(obstacles);
+	EXPECT_EQ(removed.shoot({2,1}, 3).position, 4);
+}
+
+TEST(RayIndexTest2D, FromSpan) {
+	const ObstacleSet<2> obstacles = makeObstaclesForPlane({"...", ".#.", "..."});
+	vector<Obstacle<2>> buffer(obstacles.begin(), obstacles.end());
+	RayIndex<2> index(ObstacleSpan<2>(buffer.data(), buffer.data() + buffer.size()));
+	buffer.clear();
+	EXPECT_EQ(index.shoot({2,1}, 3).position, 2);
+	EXPECT_EQ(index.shoot({2,1}, 2).obstacle, RayIndex<2>(obstacles).shoot({2,1}, 2).obstacle);
+}
+
+} // namespace
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <iterator>
 #include <vector>
 
 template<class T>
@@ -9,6 +10,13 @@ void sortUnique(std::vector<T>& v) {
 	v.erase(std::unique(v.begin(), v.end()), v.end());
 }
 
+// Moves the elements of `from` to the end of `to`, leaving `from` empty.
+template<class T>
+void moveAppend(std::vector<T>& to, std::vector<T>& from) {
+	to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+	from.clear();
+}
+
 inline int toPow2(int x) {
 	while(x & (x-1)) x+=x&-x;
 	return x;